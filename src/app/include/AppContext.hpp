@@ -26,6 +26,22 @@ namespace gem
 		int32_t x, y;
 	};
 
+	struct Timeouts // milliseconds, 0 = no limit
+	{
+		uint32_t resolve {10000};
+		uint32_t connect {10000};
+		uint32_t handshake {10000};
+		uint32_t firstByte {30000}; // from the request until the response header
+		uint32_t idle {30000}; // between two body segments
+	};
+
+	struct Proxy
+	{
+		std::string host; // empty = requests go straight to the capsules
+		uint32_t port {1965};
+		std::vector<std::string> hostPatterns; // "example.org" or "*.example.org", empty = every host
+	};
+
 	enum class DisplayMode : uint8_t
 	{
 		Windowed = 0,
@@ -41,6 +57,17 @@ namespace gem
 		Point windowResolution {1280, 720};
 		uint32_t displayIndex {0};
 		DisplayMode displayMode {DisplayMode::Windowed};
+		bool tlsEarlyData {false}; // send the request as TLS 1.3 0-RTT data when resuming a session
+		bool tcpFastOpen {false}; // send the ClientHello in the SYN packet (Linux only)
+		bool builtinResolver {false}; // asynchronous DNS resolver instead of getaddrinfo
+		std::vector<std::string> dnsServers; // "address[:port]", empty = /etc/resolv.conf
+		Timeouts timeouts;
+		uint32_t responseCacheSize {32}; // megabytes, 0 = disabled
+		uint32_t diskCacheSize {256}; // megabytes, 0 = disabled
+		uint32_t spillThreshold {8}; // megabytes of a response body kept in memory, the rest goes to a temp file, 0 = never
+		bool prefetchLinks {false}; // load linked pages of the same capsule in the background
+		uint32_t prefetchBudget {4}; // megabytes of prefetched pages not opened yet
+		Proxy proxy;
 	};
 
 	struct AppContext
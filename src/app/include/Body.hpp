@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gem
+{
+	// Response body stored in segments. Appending never moves the bytes already stored,
+	// so growing costs one copy per byte and views into the body stay valid. Readers walk the segments
+	// instead of flattening the body. Not thread-safe, a complete body is never modified.
+	// The first segments double from 4 KB up to segmentSize, a small page does not hold a full segment.
+	// Segments past the spill threshold live in a memory-mapped temp file that is deleted on close,
+	// the kernel can page them out and pages sharing the body share the mapping.
+	class Body
+	{
+	public:
+		static constexpr size_t firstSegmentSize = 4 * 1024;
+		static constexpr size_t segmentSize = 64 * 1024; // of every segment from the 5th on, power of two
+		static constexpr size_t growingSegmentCount = 5; // 4, 4, 8, 16 and 32 KB, adding up to segmentSize
+		static constexpr size_t extentSize = 64 * segmentSize; // of the temp file, mapped at once
+		static constexpr size_t defaultSpillThreshold = 8 * 1024 * 1024;
+
+		Body() = default;
+		Body(const Body &other) = delete;
+		~Body();
+
+		Body &operator=(const Body &other) = delete;
+
+		static void setSpillThreshold(size_t threshold); // bytes kept on the heap, 0 = never spill, any thread
+
+		void append(const char *data, size_t size);
+		char *prepare(size_t &size); // contiguous space at the end, size is clamped to it
+		void commit(size_t size); // of the prepared space
+
+		size_t size() const { return _size; }
+		size_t capacity() const { return getSegmentStart(_segments.size()); } // allocated bytes, heap or mapped
+		bool empty() const { return _size == 0; }
+		size_t getSegmentCount() const { return _segments.size(); }
+		std::string_view getSegment(size_t index) const;
+
+		bool isSpilled() const { return !_extents.empty(); }
+
+		char operator[](size_t index) const
+		{
+			const size_t segment = getSegmentIndex(index);
+			return _segments[segment][index - getSegmentStart(segment)];
+		}
+
+		void copy(size_t offset, size_t size, char *destination) const;
+		// Bytes split between two segments are joined in storage, anything else is viewed in place
+		std::string_view view(size_t offset, size_t size, std::deque<std::string> &storage) const;
+
+	private:
+		static constexpr size_t getSegmentStart(size_t index)
+		{
+			return index < growingSegmentCount ? (index == 0 ? 0 : firstSegmentSize << (index - 1)) : (index - growingSegmentCount + 1) * segmentSize;
+		}
+
+		static constexpr size_t getSegmentCapacity(size_t index)
+		{
+			return index < growingSegmentCount ? (index == 0 ? firstSegmentSize : firstSegmentSize << (index - 1)) : segmentSize;
+		}
+
+		static size_t getSegmentIndex(size_t offset)
+		{
+			if (offset >= segmentSize)
+			{
+				return offset / segmentSize + growingSegmentCount - 1;
+			}
+
+			size_t index = 0;
+
+			while (getSegmentStart(index + 1) <= offset)
+			{
+				index++;
+			}
+
+			return index;
+		}
+
+		char *mapSpillSegment(); // nullptr when the temp file cannot grow
+
+		std::vector<char *> _segments;
+		std::vector<std::unique_ptr<char[]>> _heapSegments; // below the spill threshold or after a failed spill
+		size_t _mappedSegmentCount {0};
+		bool _isLastSegmentMapped {false};
+		std::vector<char *> _extents; // mapped views of _spillFile
+		FILE *_spillFile {nullptr};
+		bool _canSpill {true}; // false after the temp file failed
+		size_t _size {0};
+
+		static std::atomic<size_t> _spillThreshold;
+	};
+}
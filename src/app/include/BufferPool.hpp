@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace gem
+{
+	// Resizing leaves the new elements uninitialized, a buffer about to be overwritten is not zero-filled first
+	template<typename T>
+	struct UninitializedAllocator : std::allocator<T>
+	{
+		template<typename U>
+		struct rebind
+		{
+			using other = UninitializedAllocator<U>;
+		};
+
+		UninitializedAllocator() noexcept = default;
+
+		template<typename U>
+		UninitializedAllocator(const UninitializedAllocator<U> &) noexcept {}
+
+		template<typename U>
+		void construct(U *ptr) noexcept(std::is_nothrow_default_constructible_v<U>) { ::new (static_cast<void *>(ptr)) U; }
+
+		template<typename U, typename... Args>
+		void construct(U *ptr, Args &&...args) { ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...); }
+	};
+
+	using Buffer = std::vector<char, UninitializedAllocator<char>>; // network chunks
+	// Size-classed free lists for network I/O: byte buffers for headers and body chunks, and small blocks
+	// for asio operation state and shared_ptr control blocks. Released memory is kept for reuse up to a limit per class
+	// instead of going back to the heap. Can be used from any thread, the pool lives until the process exits.
+	class BufferPool
+	{
+	public:
+		static constexpr size_t minBlockSize = 64;
+		static constexpr size_t maxBlockSize = 4096; // larger blocks come from the heap
+		static constexpr size_t minBufferCapacity = 1024;
+		static constexpr size_t maxBufferCapacity = 64 * 1024; // larger buffers are not kept
+		static constexpr size_t maxCachedBytes = 4 * 1024 * 1024; // per size class
+
+		static void *allocate(size_t size);
+		static void deallocate(void *ptr, size_t size);
+
+		// An empty buffer with at least the given capacity, it returns to the pool when the last reference is released
+		static std::shared_ptr<Buffer> acquireBuffer(size_t capacity);
+	};
+
+	template<typename T>
+	struct PoolAllocator
+	{
+		using value_type = T;
+
+		PoolAllocator() noexcept = default;
+
+		template<typename U>
+		PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+		T *allocate(size_t count) { return static_cast<T *>(BufferPool::allocate(count * sizeof(T))); }
+		void deallocate(T *ptr, size_t count) noexcept { BufferPool::deallocate(ptr, count * sizeof(T)); }
+
+		template<typename U>
+		bool operator==(const PoolAllocator<U> &) const noexcept { return true; }
+
+		template<typename U>
+		bool operator!=(const PoolAllocator<U> &) const noexcept { return false; }
+	};
+
+	// Makes asio allocate the operation state of a completion handler from the pool (associated allocator)
+	template<typename Handler>
+	class PooledHandler
+	{
+	public:
+		using allocator_type = PoolAllocator<void>;
+
+		explicit PooledHandler(Handler handler) : _handler {std::move(handler)} {}
+
+		allocator_type get_allocator() const noexcept { return {}; }
+
+		template<typename... Args>
+		void operator()(Args &&...args) { _handler(std::forward<Args>(args)...); }
+
+	private:
+		Handler _handler;
+	};
+
+	template<typename Handler>
+	PooledHandler<Handler> bindPoolAllocator(Handler handler)
+	{
+		return PooledHandler<Handler>(std::move(handler));
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/any_io_executor.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/steady_timer.hpp>
+
+namespace gem
+{
+	// Happy Eyeballs (RFC 8305): connects to the resolved endpoints with interleaved address families,
+	// starting a new attempt every attemptDelay or as soon as the previous one fails. The first connected socket wins.
+	// Must be used from the network thread only.
+	class ConnectionRacer : public std::enable_shared_from_this<ConnectionRacer>
+	{
+	public:
+		// isKnownPath: the only candidate, or the family that won the last race for the host. Connections reporting success
+		// before the handshake (TCP Fast Open) are only safe there, since they would win the race even on a dead path
+		using SocketOpener = std::function<void(asio::ip::tcp::socket &socket, const asio::ip::tcp::endpoint &endpoint, bool isKnownPath)>;
+		using RaceCallback = std::function<void(const asio::error_code &ec, asio::ip::tcp::socket socket)>;
+
+		static constexpr std::chrono::milliseconds attemptDelay {250};
+		static constexpr std::chrono::minutes familyTtl {10}; // how long the winning address family is remembered
+
+		ConnectionRacer(const asio::any_io_executor &executor, std::string hostName, const asio::ip::tcp::resolver::results_type &endpoints, SocketOpener opener);
+
+		void start(RaceCallback callback);
+		void cancel(); // the callback receives operation_aborted
+
+	private:
+		struct Winner
+		{
+			bool isIpv4;
+			std::chrono::steady_clock::time_point expirationTime;
+		};
+
+		void startNextAttempt();
+		void finishAttempt(size_t index, const asio::error_code &ec);
+
+		asio::any_io_executor _executor;
+		std::string _hostName;
+		SocketOpener _opener;
+		RaceCallback _callback;
+		std::vector<asio::ip::tcp::endpoint> _endpoints;
+		std::vector<asio::ip::tcp::socket> _sockets;
+		asio::steady_timer _timer;
+		asio::error_code _lastError;
+		size_t _nextAttemptIndex {0};
+		size_t _pendingAttempts {0};
+		bool _isFinished {false};
+		bool _hasKnownFamily {false}; // _endpoints start with the family of the last winner
+
+		static void storeWinner(const std::string &hostName, bool isIpv4);
+
+		static constexpr size_t _maxWinners = 1024;
+		static std::unordered_map<std::string, Winner> _winners; // address family that won the last race per host
+	};
+}
\ No newline at end of file
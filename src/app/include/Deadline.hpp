@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <asio/any_io_executor.hpp>
+#include <asio/steady_timer.hpp>
+
+namespace gem
+{
+	// Gives every phase of a request its own time limit and lets the whole request be cancelled.
+	// On expiry the phase's interrupt handler unblocks the pending operation, usually by closing the socket,
+	// and the completion handler reports the failure after checking isExpired(). Must be used from the network thread only.
+	class Deadline : public std::enable_shared_from_this<Deadline>
+	{
+	public:
+		using InterruptHandler = std::function<void()>;
+
+		enum class Reason : uint8_t
+		{
+			None = 0,
+			TimedOut,
+			Cancelled
+		};
+
+		Deadline(const asio::any_io_executor &executor);
+		Deadline(const Deadline &other) = delete;
+
+		Deadline &operator=(const Deadline &other) = delete;
+
+		void startPhase(std::chrono::milliseconds timeout, InterruptHandler interrupt); // zero timeout = no limit
+		void finishPhase();
+		void cancel();
+
+		bool isExpired() const { return _reason != Reason::None; }
+		Reason getReason() const { return _reason; }
+
+	private:
+		void expire(uint32_t phase, Reason reason);
+
+		asio::steady_timer _timer;
+		InterruptHandler _interrupt;
+		uint32_t _phase {0};
+		Reason _reason {Reason::None};
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ResponseCache.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <asio/thread_pool.hpp>
+
+#include "LockFreeQueue.hpp"
+
+namespace gem
+{
+	// Persistent response cache in the app data directory. A fixed-size memory-mapped index maps URL hashes
+	// to records in an append-only blob file, so opening it costs one mmap and never touches the blobs.
+	// Once the blob file outgrows the budget, the most recently fetched records are copied to a new generation.
+	// Files are accessed on a background thread, callbacks are invoked by poll() on the UI thread.
+	class DiskCache
+	{
+	public:
+		using LoadCallback = std::function<void(std::optional<CachedResponse> response)>;
+
+		static constexpr size_t defaultCapacity = 256 * 1024 * 1024;
+		static constexpr std::chrono::seconds anyAge {0};
+
+		static void open(std::string directory, size_t capacity); // capacity in bytes, 0 = disabled
+		static void close();
+
+		static void loadAsync(std::string url, std::chrono::seconds maxAge, LoadCallback callback);
+		static void store(std::string url, CachedResponse response);
+
+		static void poll(); // invokes completed callbacks on the calling (UI) thread
+
+	private:
+		struct IndexHeader;
+		struct IndexEntry;
+
+		static std::optional<CachedResponse> load(const std::string &url, std::chrono::seconds maxAge);
+		static void write(const std::string &url, const CachedResponse &response);
+		static IndexEntry *findSlot(uint64_t hash); // the entry with this hash or the empty slot where it belongs
+		static void compact(size_t targetSize, uint32_t targetCount);
+		static bool mapIndex(const std::string &path);
+		static void unmapIndex();
+		static std::string getBlobPath(uint32_t generation);
+
+		static std::optional<asio::thread_pool> _fileThread; // from open() to close(), none while disabled
+		static LockFreeQueue<std::function<void()>> _completions;
+
+		// file thread only
+		static std::string _directory;
+		static size_t _capacity;
+		static IndexHeader *_header;
+		static IndexEntry *_entries;
+		static size_t _indexSize;
+		static FILE *_blobFile;
+	};
+}
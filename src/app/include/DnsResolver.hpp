@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/ip/udp.hpp>
+
+namespace gem
+{
+	// Asynchronous stub resolver running on the network io_context.
+	// Sends A and AAAA queries in parallel over UDP (TCP when truncated) to the configured name servers.
+	// Must be used from the network thread only.
+	class DnsResolver
+	{
+	public:
+		using ResolveCallback = std::function<void(const asio::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints, std::chrono::seconds ttl)>;
+
+		static constexpr std::chrono::seconds hostsFileTtl {300};
+
+		DnsResolver(asio::io_context &ioContext);
+		DnsResolver(const DnsResolver &other) = delete;
+
+		DnsResolver &operator=(const DnsResolver &other) = delete;
+
+		bool configure(const std::vector<std::string> &nameServers); // "address[:port]", empty = read /etc/resolv.conf
+		void resolveAsync(std::string_view hostName, size_t port, const ResolveCallback &callback);
+
+	private:
+		void loadResolvConf(std::string_view path);
+		void loadHosts(std::string_view path);
+
+		asio::io_context &_ioContext;
+		std::vector<asio::ip::udp::endpoint> _nameServers;
+		std::unordered_multimap<std::string, asio::ip::address> _hosts; // /etc/hosts
+		std::chrono::milliseconds _timeout {5000};
+		int _attempts {2};
+	};
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FileWriter.hpp"
+#include "GeminiClient.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <asio/thread_pool.hpp>
+
+namespace gem
+{
+	enum class DownloadState : uint8_t
+	{
+		ChoosingPath = 0,
+		Receiving,
+		Completed,
+		Failed,
+		Cancelled
+	};
+
+	struct Download
+	{
+		std::string url;
+		std::string fileName;
+		std::atomic<DownloadState> state {DownloadState::ChoosingPath};
+
+		// UI thread only
+		std::weak_ptr<GeminiClient> client;
+		uint64_t bytesReceived {0};
+		uint64_t bytesPerSecond {0};
+		uint64_t sampleBytes {0};
+		std::chrono::steady_clock::time_point sampleTime;
+
+		// file thread only
+		std::string path;
+		std::unique_ptr<FileWriter> file;
+		std::vector<std::shared_ptr<Buffer>> pendingChunks; // received while the path is being chosen
+		bool isReceived {false};
+		bool isClosing {false}; // waiting for the queued writes
+	};
+
+	// Writes response bodies to disk while they arrive, the save dialog and the file writes run on background threads.
+	// Memory stays bounded because chunks are held until written. Must be used from the UI thread only.
+	class DownloadManager
+	{
+	public:
+		static void start(const std::shared_ptr<GeminiClient> &client, std::string url, std::string fileName);
+		static void cancel(const std::shared_ptr<Download> &download);
+		static void removeFinished();
+		static void update(); // samples transfer rates
+		static void shutdown(); // cancels unfinished downloads and waits for the background threads
+
+		static const std::vector<std::shared_ptr<Download>> &getDownloads();
+
+	private:
+		static void receiveChunk(std::shared_ptr<GeminiClient> client, std::shared_ptr<Download> download, GeminiClient::ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk);
+		static void choosePath(const std::shared_ptr<Download> &download); // dialog thread
+		static void openFile(const std::shared_ptr<Download> &download, std::string path); // file thread
+		static void writeChunk(const std::shared_ptr<Download> &download, const std::shared_ptr<Buffer> &chunk); // file thread
+		static void closeFile(const std::shared_ptr<Download> &download, DownloadState state); // file thread
+		static void finishFile(const std::shared_ptr<Download> &download, DownloadState state); // file thread, after the file is closed
+
+		static std::vector<std::shared_ptr<Download>> _downloads;
+		static std::optional<asio::thread_pool> _dialogThread; // started with the first download
+		static std::optional<asio::thread_pool> _fileThread;
+	};
+}
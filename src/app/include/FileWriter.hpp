@@ -0,0 +1,53 @@
+#pragma once
+
+#include "BufferPool.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <asio/any_io_executor.hpp>
+
+#if defined(GEM_IO_URING)
+	#include <asio/stream_file.hpp>
+#endif
+
+namespace gem
+{
+	// Appends chunks to a file in order, must be used from a single-threaded executor. io_uring builds (GEM_IO_URING)
+	// submit the writes asynchronously and gather the chunks queued meanwhile into one write, so the thread never waits
+	// for the disk. Otherwise chunks are written with stdio right away.
+	class FileWriter
+	{
+	public:
+		using CloseCallback = std::function<void(bool isWritten)>; // false after any write failed
+
+		explicit FileWriter(const asio::any_io_executor &executor);
+		FileWriter(const FileWriter &other) = delete;
+		~FileWriter();
+
+		FileWriter &operator=(const FileWriter &other) = delete;
+
+		bool open(const std::string &path); // truncates an existing file
+		void write(std::shared_ptr<Buffer> chunk); // the chunk is held until written
+		void close(CloseCallback callback); // once queued writes finish, the callback is posted to the executor
+
+		bool hasFailed() const { return _hasFailed; }
+
+	private:
+#if defined(GEM_IO_URING)
+		void writeQueuedAsync();
+
+		asio::stream_file _file;
+		std::vector<std::shared_ptr<Buffer>> _queuedChunks;
+		std::vector<std::shared_ptr<Buffer>> _writingChunks; // one write in flight at most
+		CloseCallback _closeCallback; // waits for _writingChunks
+#else
+		asio::any_io_executor _executor;
+		FILE *_file {nullptr};
+#endif
+		bool _hasFailed {false};
+	};
+}
@@ -1,17 +1,41 @@
 #pragma once
 
+#include "AppContext.hpp"
+#include "BufferPool.hpp"
 #include "StatusCode.hpp"
 
+#include <chrono>
 #include <cstddef>
+#include <functional>
 #include <string>
 #include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "Deadline.hpp"
+#include "LockFreeQueue.hpp"
+#include "ResolverCache.hpp"
+#include "TlsSessionCache.hpp"
+
+#include <asio/executor_work_guard.hpp>
 #include <asio/io_context.hpp>
 #include <asio/ssl.hpp>
 #include <asio/ip/tcp.hpp>
 
 namespace gem
 {
+	// TLS configuration presenting one client certificate. It keeps its own TLS sessions,
+	// so a session established with one identity is never resumed by another.
+	struct ClientIdentity
+	{
+		ClientIdentity() : context {asio::ssl::context::tls_client} {}
+
+		TlsSessionCache sessionCache; // must be initialized before context is configured
+		asio::ssl::context context;
+	};
+
 	class GeminiClient
 	{
 	public:
@@ -24,23 +48,65 @@ namespace gem
 			REQUEST_ERROR = 4,
 			RESPONSE_HEADER_ERROR = 5,
 			RESPONSE_BODY_ERROR = 6,
-			RESPONSE_HEADER_MALFORMED = 7
+			RESPONSE_HEADER_MALFORMED = 7,
+			TIMEOUT = 8,
+			CANCELLED = 9,
+			CERTIFICATE_MISMATCH = 10
 		};
 
 		using ConnectionCallback = std::function<void(ClientCode clientCode)>;
 		using ResponseHeaderCallback = std::function<void(ClientCode clientCode, StatusCode statusCode, std::string meta)>;
-		using ResponseBodyCallback = std::function<void(ClientCode clientCode, std::shared_ptr<std::vector<char>> data)>;
+		using ResponseChunkCallback = std::function<void(ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk)>;
+
+		static constexpr size_t defaultMaxBufferedSize = 1024 * 1024;
+		static constexpr size_t maxPreconnections = 4;
+		static constexpr std::chrono::seconds preconnectGracePeriod {10}; // an unused preconnection is closed afterwards
+
+		GeminiClient();
+		GeminiClient(const GeminiClient &other) = delete;
+		~GeminiClient();
 
-		void connectAsync(const ConnectionCallback &callback, std::string url, size_t port = 1965);
-		void receiveResponseHeaderAsync(const ResponseHeaderCallback &callback);
-		void receiveResponseBodyAsync(const ResponseBodyCallback &callback);
+		GeminiClient &operator=(const GeminiClient &other) = delete;
 
-		static void poll();
+		// Callbacks are invoked on the UI thread (see poll), the network thread moves them along instead of copying
+		void connectAsync(ConnectionCallback callback, std::string url, size_t port = 1965, std::shared_ptr<ClientIdentity> identity = nullptr);
+		void receiveResponseHeaderAsync(ResponseHeaderCallback callback);
+		// Delivers the body segment by segment, reading pauses while the consumer holds maxBufferedSize bytes of chunks
+		void receiveResponseBodyStreamAsync(ResponseChunkCallback callback, size_t maxBufferedSize = defaultMaxBufferedSize);
+		void cancel(); // closes the connection, the pending callback receives CANCELLED
+
+		static void prefetchHosts(std::vector<std::string> hostNames, size_t port = 1965); // warms up the resolver cache
+		// Speculatively resolves, connects and completes the TLS handshake, the next connectAsync to the host adopts the connection
+		static void preconnect(std::string hostName, size_t port = 1965);
+		static void cancelPreconnect(std::string hostName, size_t port = 1965); // stops a preconnection still in progress
+
+		// Parses the certificate and the key once, the identity is shared by every connection using it. nullptr on failure
+		static std::shared_ptr<ClientIdentity> createIdentity(const std::string &certificatePath, const std::string &keyPath);
+
+		static void startNetworkThread(const Settings &settings, std::string knownHostsPath);
+		static void stopNetworkThread();
+		static void poll(); // invokes completed callbacks on the calling (UI) thread
 
 	private:
+		struct BodyStream;
+		struct Preconnection;
+
+		void startConnection(std::string url, size_t port, ConnectionCallback callback, bool canRetry);
+
+		static void dispatch(std::function<void()> handler);
+
 		asio::ssl::stream<asio::ip::tcp::socket> *_socket {nullptr};
+		std::shared_ptr<Deadline> _deadline;
+		std::shared_ptr<ClientIdentity> _identity; // outlives _socket
+		std::shared_ptr<Buffer> _readBuffer; // pooled, body bytes received together with the header become the first chunk, network thread only
 
 		static asio::io_context _ioContext;
+		static ResolverCache _resolverCache;
+		static TlsSessionCache _sessionCache; // must be initialized before _sslContext
 		static asio::ssl::context _sslContext;
+		static std::optional<asio::executor_work_guard<asio::io_context::executor_type>> _workGuard;
+		static std::thread _networkThread;
+		static LockFreeQueue<std::function<void()>> _completionQueue;
+		static std::unordered_map<std::string, std::shared_ptr<Preconnection>> _preconnections; // "host:port", network thread only
 	};
 }
\ No newline at end of file
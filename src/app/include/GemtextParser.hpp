@@ -1,5 +1,8 @@
 #pragma once
 
+#include "Body.hpp"
+
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -28,6 +31,6 @@ namespace gem
 	class GemtextParser
 	{
 	public:
-		static void parse(std::vector<GemtextLine> &lines, const std::vector<char> &data);
+		static void parse(std::vector<GemtextLine> &lines, std::deque<std::string> &joinedText, const Body &data); // lines may point into joinedText
 	};
 }
\ No newline at end of file
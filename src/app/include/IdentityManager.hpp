@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GeminiClient.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <asio/thread_pool.hpp>
+
+#include "LockFreeQueue.hpp"
+
+namespace gem
+{
+	// Client certificates for capsules that require one (status 60). Each identity is a self-signed certificate
+	// with its key, stored in the identities directory and used for every URL under its prefixes.
+	// The TLS context of an identity is built once and shared by all its connections.
+	// Keys are generated on a background thread, otherwise must be used from the UI thread only.
+	class IdentityManager
+	{
+	public:
+		using CreateCallback = std::function<void(bool isCreated)>;
+
+		static void load(std::string directory);
+		static void save();
+		static void shutdown(); // waits for keys being generated
+
+		// Generates a keypair and a certificate for urlPrefix, the callback is invoked by poll()
+		static void createAsync(std::string name, std::string urlPrefix, CreateCallback callback);
+		static bool isCreating(std::string_view urlPrefix);
+		static std::shared_ptr<ClientIdentity> find(std::string_view url); // identity of the longest matching prefix, nullptr if none
+
+		static void poll();
+
+	private:
+		struct Identity
+		{
+			uint32_t id;
+			std::string name;
+			std::vector<std::string> urlPrefixes;
+			std::shared_ptr<ClientIdentity> context; // built on first use
+		};
+
+		struct Completion
+		{
+			Identity identity;
+			std::shared_ptr<ClientIdentity> context; // nullptr = generation failed
+			CreateCallback callback;
+		};
+
+		static bool generate(const Identity &identity); // background thread
+		static void add(Identity identity);
+		static std::string getCertificatePath(uint32_t id);
+		static std::string getKeyPath(uint32_t id);
+
+		static std::string _directory;
+		static std::vector<Identity> _identities;
+		static std::vector<std::pair<std::string, size_t>> _prefixes; // URL prefix and identity index, longest first
+		static std::vector<std::string> _pendingPrefixes;
+		static uint32_t _lastId;
+		static std::optional<asio::thread_pool> _keyThread; // started with the first key
+		static LockFreeQueue<Completion> _completions;
+	};
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+
+namespace gem
+{
+	// Trust on first use: remembers the public key (SHA-256 of the SPKI) each host presented first.
+	// The file is a header followed by fixed-size records, it is memory-mapped once at startup and only appended to,
+	// a later record for a host replaces the earlier ones. Must be used from the network thread only.
+	class KnownHosts
+	{
+	public:
+		enum class Result
+		{
+			Trusted,
+			FirstUse, // remembered now
+			Replaced, // the remembered certificate had expired
+			Mismatch
+		};
+
+		KnownHosts() = default;
+		KnownHosts(const KnownHosts &other) = delete;
+		~KnownHosts();
+
+		KnownHosts &operator=(const KnownHosts &other) = delete;
+
+		void open(const std::string &path);
+		void close();
+
+		Result verify(SSL *ssl, std::string_view hostName, size_t port); // checks the peer certificate of a completed handshake
+
+	private:
+		using Fingerprint = std::array<uint8_t, 32>;
+
+		struct Record;
+
+		struct Host
+		{
+			Fingerprint fingerprint;
+			int64_t expiryTime; // seconds since the epoch
+		};
+
+		void append(uint64_t hash, const Host &host);
+
+		std::unordered_map<uint64_t, Host> _hosts; // by hash of "host:port"
+		std::string _path;
+		FILE *_file {nullptr};
+	};
+}
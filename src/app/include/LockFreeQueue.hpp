@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace gem
+{
+	// Multiple producers, single consumer (intrusive Vyukov queue)
+	template<typename T>
+	class LockFreeQueue
+	{
+	public:
+		LockFreeQueue() :
+			_head {new Node()},
+			_tail {_head.load(std::memory_order_relaxed)}
+		{
+		}
+
+		LockFreeQueue(const LockFreeQueue &other) = delete;
+
+		~LockFreeQueue()
+		{
+			for (T value; pop(value););
+
+			delete _tail;
+		}
+
+		LockFreeQueue &operator=(const LockFreeQueue &other) = delete;
+
+		// can be called from any thread
+		void push(T value)
+		{
+			Node *node = new Node {std::move(value)};
+			Node *prev = _head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		// must be called from the consumer thread only
+		bool pop(T &value)
+		{
+			Node *tail = _tail;
+			Node *next = tail->next.load(std::memory_order_acquire);
+
+			if (next == nullptr)
+			{
+				return false;
+			}
+
+			value = std::move(next->value);
+			_tail = next;
+			delete tail;
+
+			return true;
+		}
+
+	private:
+		struct Node
+		{
+			T value {};
+			std::atomic<Node *> next {nullptr};
+		};
+
+		std::atomic<Node *> _head;
+		Node *_tail;
+	};
+}
\ No newline at end of file
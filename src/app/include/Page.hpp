@@ -3,6 +3,11 @@
 #include "StatusCode.hpp"
 #include "GeminiClient.hpp"
 #include "GemtextParser.hpp"
+#include "RequestScheduler.hpp"
+#include "ResponseCache.hpp"
+
+#include <chrono>
+#include <unordered_map>
 
 namespace gem
 {
@@ -15,7 +20,9 @@ namespace gem
 		Unsupported, // file format is not supported == dowload file
 
 		NewTab = 100,
-		Settings
+		Settings,
+		Statistics,
+		Downloads
 	};
 
 	struct PageData
@@ -25,6 +32,13 @@ namespace gem
 	struct GemtextPageData : public PageData
 	{
 		std::vector<GemtextLine> lines;
+		std::deque<std::string> joinedText; // lines split between two body segments
+	};
+
+	struct TextPageData : public PageData
+	{
+		std::vector<std::string_view> blocks; // each ends at a line break, drawn without spacing they read as one text
+		std::deque<std::string> joinedText; // lines split between two body segments
 	};
 
 	struct ImagePageData : public PageData
@@ -43,9 +57,10 @@ namespace gem
 
 		std::string_view getUrl();
 		std::string_view getLabel();
-		std::string_view getData();
+		const Body &getData(); // empty until the body arrives
 		std::string_view getError();
 
+		StatusCode getStatusCode();
 		PageType getPageType();
 
 		template<typename T>
@@ -56,34 +71,63 @@ namespace gem
 		}
 
 		bool isLoaded();
-		bool isDownloaded();
 
-		void load();
-		void download(const char *path);
+		void load(bool isReload = false); // a reload bypasses the response cache
+		void cancel();
+		void setPriority(RequestPriority priority);
 
 		static const Page newTabPage;
+		static const Page statisticsPage;
+		static const Page downloadsPage;
+
+		static constexpr int defaultSlowDownDelay = 10; // seconds, when 44 comes without a valid delay
+		static constexpr int maxSlowDownDelay = 120; // longer delays are shown as an error
+		static constexpr uint32_t maxSlowDownRetries = 3;
+		static constexpr uint32_t maxRedirects = 5;
 
 	private:
 		Page(PageType type, std::string_view label);
 
-		void init(StatusCode code, std::string meta, std::shared_ptr<std::vector<char>> data);
-		void setError(GeminiClient::ClientCode code);
+		struct Transfer; // one fetch shared by every page loading the same URL
 
-		static void connectAsyncCallback(std::shared_ptr<GeminiClient> client, std::weak_ptr<Page> pageWeakPtr, GeminiClient::ClientCode clientCode);
-		static void receiveResponseHeaderAsyncCallback(std::shared_ptr<GeminiClient> client, std::weak_ptr<Page> pageWeakPtr, GeminiClient::ClientCode clientCode, StatusCode statusCode, std::string meta);
-		static void receiveResponseBodyAsyncCallback(std::weak_ptr<Page> pageWeakPtr, StatusCode statusCode, std::string meta, GeminiClient::ClientCode clientCode, std::shared_ptr<std::vector<char>> data);
+		void init(StatusCode code, std::string meta, std::shared_ptr<Body> data);
+		void onData(bool isLastChunk); // the shared body has grown
+		void parseGemtext();
+		void splitText();
+		void setError(GeminiClient::ClientCode code);
+		void setLoaded();
+		void abort(); // leaves the transfer, the last page to leave stops it
+
+		static void startTransfer(const std::shared_ptr<Transfer> &transfer);
+		static void finishTransfer(const std::shared_ptr<Transfer> &transfer);
+		static void failTransfer(const std::shared_ptr<Transfer> &transfer, GeminiClient::ClientCode clientCode); // falls back to the disk cache when offline
+		static void completeFromCache(const std::shared_ptr<Transfer> &transfer, const CachedResponse &response);
+		static void updatePriority(const std::shared_ptr<Transfer> &transfer);
+		static std::vector<std::shared_ptr<Page>> getPages(const std::shared_ptr<Transfer> &transfer);
+		static bool followRedirect(const std::shared_ptr<Transfer> &transfer, StatusCode statusCode, std::string_view meta);
+		static bool retryAfterSlowDown(const std::shared_ptr<Transfer> &transfer, std::string_view meta);
+
+		static void connectAsyncCallback(std::shared_ptr<GeminiClient> client, std::shared_ptr<Transfer> transfer, GeminiClient::ClientCode clientCode);
+		static void receiveResponseHeaderAsyncCallback(std::shared_ptr<GeminiClient> client, std::shared_ptr<Transfer> transfer, GeminiClient::ClientCode clientCode, StatusCode statusCode, std::string meta);
+		static void receiveResponseChunkCallback(std::shared_ptr<Transfer> transfer, GeminiClient::ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk);
 
 		std::string _url;
+		std::string _requestedUrl; // before redirects, a reload asks the server again
 		std::string _label;
 		PageType _pageType {PageType::None};
 		PageData *_pageData {nullptr};
 
 		bool _isLoaded {false};
-		bool _isDownloaded {false};
+		std::chrono::steady_clock::time_point _loadStartTime;
+		std::shared_ptr<Transfer> _transfer; // while loading
+		RequestPriority _priority {RequestPriority::Foreground};
 
 		StatusCode _code {StatusCode::NONE};
 		std::string _error;
 		std::string _meta;
-		std::shared_ptr<std::vector<char>> _binaryData;
+		std::shared_ptr<Body> _binaryData;
+		size_t _parsedSize {0}; // segments never move, so the parsed lines stay valid while the body grows
+
+		static std::unordered_map<std::string, std::shared_ptr<Transfer>> _transfers; // in flight, by normalized URL
 	};
 }
\ No newline at end of file
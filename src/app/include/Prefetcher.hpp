@@ -0,0 +1,57 @@
+#pragma once
+
+#include "GemtextParser.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gem
+{
+	class Page;
+
+	// Opt-in background loading of the pages a gemtext page links to on the same capsule, at speculative priority.
+	// Results land in the response cache, where opening the link finds them. Prefetched pages that were not opened yet
+	// are limited per capsule and by a global byte budget. Must be used from the UI thread only.
+	class Prefetcher
+	{
+	public:
+		static constexpr size_t maxLinksPerPage = 4;
+		static constexpr size_t maxPagesPerHost = 8; // prefetched or in flight, not opened yet
+		static constexpr std::chrono::minutes unusedExpiration {10}; // no longer counted afterwards
+
+		static void setBudget(size_t budget); // bytes, 0 = disabled and stops prefetches in flight
+		static void prefetchLinks(std::string_view pageUrl, const std::vector<GemtextLine> &lines);
+		static void markUsed(const std::string &url); // normalized URL the user opened
+		static void update(); // collects finished prefetches, stops the ones exceeding the budget
+
+	private:
+		struct Prefetch
+		{
+			std::string url; // normalized
+			std::string hostName;
+			std::shared_ptr<Page> page;
+			bool isUsed {false};
+		};
+
+		struct UnusedPage
+		{
+			std::string hostName;
+			size_t size;
+			std::chrono::steady_clock::time_point time;
+		};
+
+		static bool isWorthPrefetching(std::string_view url);
+		static bool isKnown(const std::string &url);
+		static size_t getHostPageCount(std::string_view hostName);
+		static size_t getUsedSize(); // by unused pages and prefetches in flight
+
+		static std::vector<Prefetch> _prefetches; // in flight
+		static std::unordered_map<std::string, UnusedPage> _unusedPages;
+		static size_t _budget;
+	};
+}
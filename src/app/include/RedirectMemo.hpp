@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace gem
+{
+	// Remembers permanent redirects across sessions, so navigating to an old URL goes straight to its new location.
+	// Keyed by normalized URL, the oldest entries are dropped first. Must be used from the UI thread only.
+	class RedirectMemo
+	{
+	public:
+		static constexpr size_t maxEntries = 4096;
+
+		static void save(std::string_view path);
+		static void load(std::string_view path);
+
+		static const std::string *find(const std::string &url);
+		static void store(const std::string &url, std::string target);
+		static void remove(const std::string &url);
+
+	private:
+		static std::unordered_map<std::string, std::string> _targets;
+		static std::deque<std::string> _urls; // in insertion order
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gem
+{
+	enum class RequestPriority : uint8_t
+	{
+		Foreground = 0, // page in the selected tab
+		Background, // page in another tab
+		Speculative // prefetch
+	};
+
+	// Starts requests in priority order while bounding the number of connections per host and in total.
+	// Speculative requests wait until no other request is queued or running, so they never compete with pages being viewed.
+	// Hosts that answered 44 SLOW DOWN get no new connections until their delay elapses. Must be used from the UI thread only.
+	class RequestScheduler
+	{
+	public:
+		using RequestId = uint64_t; // 0 = none
+		using StartHandler = std::function<void()>;
+
+		static constexpr size_t maxConnections = 16;
+		static constexpr size_t maxConnectionsPerHost = 2;
+
+		static RequestId submit(std::string hostName, RequestPriority priority, StartHandler start); // may start right away
+		static void setPriority(RequestId requestId, RequestPriority priority);
+		static void finish(RequestId requestId); // releases the connection slot
+		static bool cancel(RequestId requestId); // true when the request was still queued
+		static void slowDown(std::string_view hostName, std::chrono::seconds delay);
+		static void update(); // starts requests whose hosts are available again
+
+	private:
+		struct Request
+		{
+			RequestId id;
+			std::string hostName;
+			RequestPriority priority;
+			StartHandler start;
+		};
+
+		struct ActiveRequest
+		{
+			std::string hostName;
+			RequestPriority priority;
+		};
+
+		struct Host
+		{
+			size_t activeCount {0};
+			std::chrono::steady_clock::time_point pausedUntil;
+		};
+
+		static bool isAvailable(const std::string &hostName, std::chrono::steady_clock::time_point now);
+		static void startReadyRequests();
+
+		static std::vector<Request> _queue; // in submission order
+		static std::unordered_map<RequestId, ActiveRequest> _activeRequests;
+		static std::unordered_map<std::string, Host> _hosts;
+		static RequestId _lastRequestId;
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+
+#include "DnsResolver.hpp"
+
+namespace gem
+{
+	// Process-wide cache of host name lookups with positive and negative entries.
+	// Concurrent lookups of the same host share one query. Must be used from the network thread only.
+	class ResolverCache
+	{
+	public:
+		using ResolveCallback = std::function<void(const asio::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints)>;
+
+		static constexpr std::chrono::seconds positiveTtl {300};
+		static constexpr std::chrono::seconds negativeTtl {30};
+
+		ResolverCache(asio::io_context &ioContext);
+		ResolverCache(const ResolverCache &other) = delete;
+		~ResolverCache();
+
+		ResolverCache &operator=(const ResolverCache &other) = delete;
+
+		void useDnsResolver(const std::vector<std::string> &nameServers); // instead of the system resolver
+		void resolveAsync(std::string_view hostName, size_t port, const ResolveCallback &callback);
+		void prefetch(std::string_view hostName, size_t port);
+
+	private:
+		struct Entry
+		{
+			asio::error_code error;
+			asio::ip::tcp::resolver::results_type endpoints;
+			std::chrono::steady_clock::time_point expirationTime;
+			std::vector<ResolveCallback> waiters;
+			bool isPending {false};
+		};
+
+		void lookup(const std::string &key, std::string hostName, size_t port);
+		void store(const std::string &key, const asio::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints, std::chrono::seconds ttl);
+		void removeExpiredEntries();
+
+		static constexpr size_t _maxEntries = 1024;
+
+		asio::io_context &_ioContext;
+		std::unique_ptr<DnsResolver> _dnsResolver;
+		std::unordered_map<std::string, Entry> _entries; // "host:port"
+	};
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Body.hpp"
+#include "StatusCode.hpp"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace gem
+{
+	struct CachedResponse
+	{
+		StatusCode statusCode;
+		std::string meta;
+		std::shared_ptr<Body> body; // shared with the pages showing it, never modified
+	};
+
+	// Process-wide LRU cache of complete responses keyed by normalized URL, shared by every window.
+	// The least recently used entries are evicted once the byte budget is exceeded. Must be used from the UI thread only.
+	class ResponseCache
+	{
+	public:
+		static constexpr size_t defaultCapacity = 32 * 1024 * 1024;
+
+		static void setCapacity(size_t capacity); // bytes, 0 = disabled
+		static const CachedResponse *find(const std::string &url); // marks the entry as recently used
+		static bool contains(const std::string &url);
+		static void store(const std::string &url, CachedResponse response);
+		static void remove(const std::string &url);
+
+		static size_t getSize();
+		static size_t getCapacity();
+
+	private:
+		struct Entry
+		{
+			std::string url;
+			CachedResponse response;
+			size_t size;
+		};
+
+		static void evict(size_t capacity);
+
+		static std::list<Entry> _entries; // most recently used first
+		static std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+		static size_t _size;
+		static size_t _capacity;
+	};
+}
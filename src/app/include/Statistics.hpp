@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace gem
+{
+	// Counters are updated from both the UI and the network thread
+	struct Statistics
+	{
+		void addPageLoad(uint64_t microseconds)
+		{
+			pageLoadCount.fetch_add(1, std::memory_order_relaxed);
+			pageLoadTimeTotal.fetch_add(microseconds, std::memory_order_relaxed);
+
+			for (uint64_t max = pageLoadTimeMax.load(std::memory_order_relaxed);
+				max < microseconds && !pageLoadTimeMax.compare_exchange_weak(max, microseconds, std::memory_order_relaxed););
+		}
+
+		std::atomic<uint64_t> pageLoadCount {0};
+		std::atomic<uint64_t> pageLoadTimeTotal {0}; // microseconds
+		std::atomic<uint64_t> pageLoadTimeMax {0}; // microseconds
+
+		std::atomic<uint64_t> coalescedRequests {0}; // loads that joined a transfer in flight
+		std::atomic<uint64_t> responseCacheHits {0};
+		std::atomic<uint64_t> responseCacheMisses {0}; // reloads are not counted
+		std::atomic<uint64_t> diskCacheHits {0}; // looked up after a network failure only
+		std::atomic<uint64_t> diskCacheMisses {0};
+		std::atomic<uint64_t> offlineLoads {0}; // served from the disk cache after a network failure
+		std::atomic<uint64_t> prefetchesStarted {0}; // linked pages loaded in the background
+		std::atomic<uint64_t> prefetchesUsed {0};
+		std::atomic<uint64_t> dnsCacheHits {0};
+		std::atomic<uint64_t> dnsCacheMisses {0};
+		std::atomic<uint64_t> dnsPrefetches {0};
+		std::atomic<uint64_t> dnsQueries {0}; // sent by the built-in resolver
+		std::atomic<uint64_t> dnsTcpQueries {0}; // retried over TCP after a truncated answer
+
+		std::atomic<uint64_t> tlsFullHandshakes {0};
+		std::atomic<uint64_t> tlsResumedHandshakes {0};
+		std::atomic<uint64_t> tlsEarlyDataAccepted {0};
+		std::atomic<uint64_t> tlsEarlyDataRejected {0};
+
+		std::atomic<uint64_t> connectionRaceFallbacks {0}; // connected through a later Happy Eyeballs attempt
+		std::atomic<uint64_t> tcpFastOpenAttempts {0};
+		std::atomic<uint64_t> tcpFastOpenAccepted {0}; // data in SYN was acknowledged
+		std::atomic<uint64_t> preconnectsStarted {0}; // speculative connections to hovered links
+		std::atomic<uint64_t> preconnectsUsed {0};
+
+		std::atomic<uint64_t> clientRequests {0}; // GeminiClient::connectAsync calls
+		std::atomic<uint64_t> networkAllocations {0}; // heap allocations of the network thread, GEM_COUNT_ALLOCATIONS builds only
+		std::atomic<uint64_t> bufferPoolHits {0}; // network buffers and handler memory reused from BufferPool
+		std::atomic<uint64_t> bufferPoolMisses {0};
+		std::atomic<uint64_t> bodyBytesCopied {0}; // received body bytes appended to page bodies, growing a body never moves them
+		std::atomic<uint64_t> bodyBytesSpilled {0}; // written to memory-mapped temp files instead of the heap
+	};
+
+	inline Statistics statistics;
+	inline thread_local bool countsAllocations {false}; // set by the network thread
+}
\ No newline at end of file
@@ -7,6 +7,8 @@ namespace gem
 	class Tab
 	{
 	public:
+		static constexpr std::chrono::milliseconds preconnectHoverDelay {100};
+
 		bool isOpen();
 		void setOpen(bool open);
 
@@ -18,16 +20,27 @@ namespace gem
 
 		std::shared_ptr<Page> getCurrentPage();
 		void loadCurrentPage();
+		void reloadCurrentPage(); // bypasses the response cache
 
 		void loadNewPage(std::string_view url, bool hasSchema, std::string_view baseUrl = "");
 		void loadNewPage(std::shared_ptr<Page> page);
 
+		void hoverLink(std::string_view url, bool hasSchema); // preconnects to the host of the link
+		void updateLinkHover(); // once per frame after the links are drawn
+
 		std::string &getAddressBarText();
 
 	private:
+		void showUrl(std::string_view url);
+
 		bool _isOpen {true};
 		std::string _addressBarText;
+		std::string _shownUrl; // of the page when the address bar was last set
 		std::vector<std::shared_ptr<Page>> _pages;
 		int32_t _currentPageIndex {-1};
+		std::string _hoveredHostName; // of the hovered link
+		std::chrono::steady_clock::time_point _hoverStartTime;
+		bool _isPreconnecting {false};
+		bool _isLinkHovered {false}; // in the current frame
 	};
 }
\ No newline at end of file
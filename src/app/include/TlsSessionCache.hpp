@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+
+namespace gem
+{
+	// Keeps the latest resumable TLS session (or TLS 1.3 ticket) per host and port.
+	// Must be used from the network thread only.
+	class TlsSessionCache
+	{
+	public:
+		TlsSessionCache() = default;
+		TlsSessionCache(const TlsSessionCache &other) = delete;
+		~TlsSessionCache();
+
+		TlsSessionCache &operator=(const TlsSessionCache &other) = delete;
+
+		void attach(SSL_CTX *context);
+		void prepare(SSL *ssl, std::string_view hostName, size_t port); // sets SNI and a cached session to resume, if any
+		SSL_SESSION *find(std::string_view hostName, size_t port) const;
+
+	private:
+		static int newSessionCallback(SSL *ssl, SSL_SESSION *session);
+
+		void store(const std::string &key, SSL_SESSION *session);
+
+		static constexpr size_t _maxSessions = 256;
+
+		std::unordered_map<std::string, SSL_SESSION *> _sessions;
+	};
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <string>
 #include <string_view>
 #include <sstream>
 #include <vector>
@@ -56,4 +59,93 @@ namespace gem
 
 		return url.substr(p1);
 	}
+
+	// Makes a link absolute, baseUrl is the URL of the page containing it
+	static inline std::string resolveUrl(std::string_view url, bool hasSchema, std::string_view baseUrl)
+	{
+		std::string newUrl;
+
+		if (hasSchema)
+		{
+			newUrl = url;
+		}
+		else
+		{
+			if (url[0] == '/') // relative to host name
+			{
+				newUrl = "gemini://" + std::string(extractHostName(baseUrl)) + std::string(url);
+			}
+			else // relative to current page
+			{
+				auto getDirName = [](std::string_view path)
+				{
+					return path.substr(0, path.find_last_of('/', path.size() - 2) + 1);
+				};
+
+				if (*baseUrl.rbegin() != '/') // current page is not a directory
+				{
+					baseUrl = getDirName(baseUrl);
+				}
+
+				std::string_view relativeUrl = url;
+
+				if (relativeUrl == ".")
+				{
+					relativeUrl = "";
+				}
+				else if (relativeUrl == "..")
+				{
+					baseUrl = getDirName(baseUrl);
+					relativeUrl = "";
+				}
+				else
+				{
+					if (stringStartsWith(relativeUrl, "./"))
+					{
+						relativeUrl = relativeUrl.substr(2);
+					}
+
+					while (stringStartsWith(relativeUrl, "../"))
+					{
+						baseUrl = getDirName(baseUrl);
+						relativeUrl = relativeUrl.substr(3);
+					}
+				}
+
+				newUrl = std::string(baseUrl) + std::string(relativeUrl);
+			}
+		}
+
+		return newUrl;
+	}
+
+	// Lowercase scheme and host, no default port, no fragment, at least "/" as the path
+	static inline std::string normalizeUrl(std::string_view url)
+	{
+		std::string normalizedUrl(url.substr(0, url.find('#')));
+		size_t hostStart = normalizedUrl.find("//");
+
+		if (hostStart == std::string::npos)
+		{
+			return normalizedUrl;
+		}
+
+		hostStart += 2;
+		size_t hostEnd = normalizedUrl.find_first_of("/?", hostStart);
+
+		if (hostEnd == std::string::npos || normalizedUrl[hostEnd] == '?')
+		{
+			hostEnd = hostEnd == std::string::npos ? normalizedUrl.size() : hostEnd;
+			normalizedUrl.insert(hostEnd, 1, '/');
+		}
+
+		std::transform(normalizedUrl.begin(), normalizedUrl.begin() + hostEnd, normalizedUrl.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+		if (hostEnd >= hostStart + 5 && normalizedUrl.compare(hostEnd - 5, 5, ":1965") == 0)
+		{
+			normalizedUrl.erase(hostEnd - 5, 5);
+		}
+
+		return normalizedUrl;
+	}
 }
\ No newline at end of file
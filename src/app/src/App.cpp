@@ -1,5 +1,13 @@
 #include "App.hpp"
+#include "Body.hpp"
+#include "DiskCache.hpp"
+#include "DownloadManager.hpp"
 #include "GeminiClient.hpp"
+#include "IdentityManager.hpp"
+#include "Prefetcher.hpp"
+#include "RedirectMemo.hpp"
+#include "RequestScheduler.hpp"
+#include "ResponseCache.hpp"
 
 #include <stdexcept>
 #include <iterator>
@@ -18,6 +26,8 @@ namespace
 	static const std::string appPath = SDL_GetPrefPath(nullptr, "gem");
 	static const std::string settingsPath = appPath + "Settings.json";
 	static const std::string userDataPath = appPath + "UserData.json";
+	static const std::string redirectsPath = appPath + "Redirects.json";
+	static const std::string knownHostsPath = appPath + "KnownHosts";
 
 	static uint32_t newWindowsCount = 0;
 }
@@ -41,16 +51,34 @@ App::App()
 
 	_context.settings.load(settingsPath);
 	_context.userData.load(userDataPath);
+	RedirectMemo::load(redirectsPath);
+	IdentityManager::load(appPath + "Identities");
 
 	AppWindow::loadFonts();
 
+	GeminiClient::startNetworkThread(_context.settings, knownHostsPath);
+	ResponseCache::setCapacity(static_cast<size_t>(_context.settings.responseCacheSize) * 1024 * 1024);
+	DiskCache::open(appPath + "Cache", static_cast<size_t>(_context.settings.diskCacheSize) * 1024 * 1024);
+	Body::setSpillThreshold(static_cast<size_t>(_context.settings.spillThreshold) * 1024 * 1024);
+	Prefetcher::setBudget(_context.settings.prefetchLinks ? static_cast<size_t>(_context.settings.prefetchBudget) * 1024 * 1024 : 0);
+
 	newWindow();
 }
 
 App::~App()
 {
+	Prefetcher::setBudget(0);
+	_windows.clear(); // the pages leave their transfers, the clients post their socket deletes
+	GeminiClient::poll(); // completed callbacks still own clients
+	GeminiClient::stopNetworkThread();
+	DownloadManager::shutdown();
+	DiskCache::close();
+	IdentityManager::shutdown();
+
 	_context.settings.save(settingsPath);
 	_context.userData.save(userDataPath);
+	RedirectMemo::save(redirectsPath);
+	IdentityManager::save();
 
 	NFD_Quit();
 	SDL_Quit();
@@ -74,8 +102,11 @@ void App::update()
 	}
 
 	GeminiClient::poll();
-
-	// TODO: multi threading
+	DiskCache::poll();
+	IdentityManager::poll();
+	DownloadManager::update();
+	RequestScheduler::update();
+	Prefetcher::update();
 
 	for (AppWindow &window : _windows)
 	{
@@ -113,6 +113,64 @@ void Settings::save(std::string_view path)
 	writer.Uint(displayIndex);
 	writer.Key("displayMode");
 	writer.String(DisplayModeNames[static_cast<int>(displayMode)]);
+	writer.Key("tlsEarlyData");
+	writer.Bool(tlsEarlyData);
+	writer.Key("tcpFastOpen");
+	writer.Bool(tcpFastOpen);
+	writer.Key("builtinResolver");
+	writer.Bool(builtinResolver);
+
+	writer.Key("dnsServers");
+	writer.StartArray();
+
+	for (const std::string &dnsServer : dnsServers)
+	{
+		writer.String(dnsServer);
+	}
+
+	writer.EndArray();
+
+	writer.Key("timeouts");
+	writer.StartObject();
+	writer.Key("resolve");
+	writer.Uint(timeouts.resolve);
+	writer.Key("connect");
+	writer.Uint(timeouts.connect);
+	writer.Key("handshake");
+	writer.Uint(timeouts.handshake);
+	writer.Key("firstByte");
+	writer.Uint(timeouts.firstByte);
+	writer.Key("idle");
+	writer.Uint(timeouts.idle);
+	writer.EndObject();
+
+	writer.Key("responseCacheSize");
+	writer.Uint(responseCacheSize);
+	writer.Key("diskCacheSize");
+	writer.Uint(diskCacheSize);
+	writer.Key("spillThreshold");
+	writer.Uint(spillThreshold);
+	writer.Key("prefetchLinks");
+	writer.Bool(prefetchLinks);
+	writer.Key("prefetchBudget");
+	writer.Uint(prefetchBudget);
+
+	writer.Key("proxy");
+	writer.StartObject();
+	writer.Key("host");
+	writer.String(proxy.host);
+	writer.Key("port");
+	writer.Uint(proxy.port);
+	writer.Key("hostPatterns");
+	writer.StartArray();
+
+	for (const std::string &hostPattern : proxy.hostPatterns)
+	{
+		writer.String(hostPattern);
+	}
+
+	writer.EndArray();
+	writer.EndObject();
 
 	writer.EndObject();
 
@@ -152,4 +210,77 @@ void Settings::load(std::string_view path)
 
 	displayIndex = doc["displayIndex"].GetUint();
 	displayMode = stringToDisplayMode(doc["displayMode"].GetString());
+
+	if (doc.HasMember("tlsEarlyData"))
+	{
+		tlsEarlyData = doc["tlsEarlyData"].GetBool();
+	}
+
+	if (doc.HasMember("tcpFastOpen"))
+	{
+		tcpFastOpen = doc["tcpFastOpen"].GetBool();
+	}
+
+	if (doc.HasMember("builtinResolver"))
+	{
+		builtinResolver = doc["builtinResolver"].GetBool();
+	}
+
+	if (doc.HasMember("dnsServers"))
+	{
+		dnsServers.clear();
+
+		for (const auto &dnsServerValue : doc["dnsServers"].GetArray())
+		{
+			dnsServers.push_back(dnsServerValue.GetString());
+		}
+	}
+
+	if (doc.HasMember("timeouts"))
+	{
+		auto timeoutsObject = doc["timeouts"].GetObject();
+		timeouts.resolve = timeoutsObject["resolve"].GetUint();
+		timeouts.connect = timeoutsObject["connect"].GetUint();
+		timeouts.handshake = timeoutsObject["handshake"].GetUint();
+		timeouts.firstByte = timeoutsObject["firstByte"].GetUint();
+		timeouts.idle = timeoutsObject["idle"].GetUint();
+	}
+
+	if (doc.HasMember("responseCacheSize"))
+	{
+		responseCacheSize = doc["responseCacheSize"].GetUint();
+	}
+
+	if (doc.HasMember("diskCacheSize"))
+	{
+		diskCacheSize = doc["diskCacheSize"].GetUint();
+	}
+
+	if (doc.HasMember("spillThreshold"))
+	{
+		spillThreshold = doc["spillThreshold"].GetUint();
+	}
+
+	if (doc.HasMember("prefetchLinks"))
+	{
+		prefetchLinks = doc["prefetchLinks"].GetBool();
+	}
+
+	if (doc.HasMember("prefetchBudget"))
+	{
+		prefetchBudget = doc["prefetchBudget"].GetUint();
+	}
+
+	if (doc.HasMember("proxy"))
+	{
+		auto proxyObject = doc["proxy"].GetObject();
+		proxy.host = proxyObject["host"].GetString();
+		proxy.port = proxyObject["port"].GetUint();
+		proxy.hostPatterns.clear();
+
+		for (const auto &hostPatternValue : proxyObject["hostPatterns"].GetArray())
+		{
+			proxy.hostPatterns.push_back(hostPatternValue.GetString());
+		}
+	}
 }
\ No newline at end of file
@@ -1,9 +1,16 @@
 #include "AppWindow.hpp"
 #include "App.hpp"
 #include "AppContext.hpp"
+#include "DownloadManager.hpp"
+#include "IdentityManager.hpp"
+#include "ResponseCache.hpp"
+#include "Statistics.hpp"
+#include "Utilities.hpp"
 
+#include <cstdarg>
 #include <fstream>
 #include <filesystem>
+#include <iterator>
 #include <unordered_set>
 
 #include <SDL.h>
@@ -17,8 +24,6 @@
 
 #include <IconsFontAwesome4.h>
 
-#include <nfd.h>
-
 using namespace gem;
 
 namespace
@@ -101,6 +106,7 @@ namespace
 			min.y = max.y;
 			ImGui::GetWindowDrawList()->AddLine(min, max, linkColorU32, 1.0f);
 			ImGui::SetTooltip("%.*s", static_cast<int>(line.link.size()), line.link.data());
+			tabs[currentTabIndex].hoverLink(line.link, line.linkHasSchema);
 		}
 
 		if (ImGui::BeginPopupContextItem())
@@ -262,14 +268,29 @@ namespace
 
 		ImGui::PopStyleVar(2);
 		ImGui::PopFont();
+
+		tabs[currentTabIndex].updateLinkHover();
 	}
 
 	static void drawTextPage(Tab &tab)
 	{
 		std::shared_ptr<Page> page = tab.getCurrentPage();
-		std::string_view teztData = page->getData();
+		TextPageData *textData = page->getPageData<TextPageData>();
+
+		if (textData == nullptr)
+		{
+			return;
+		}
 
-		drawText(teztData);
+		// blocks end at line breaks, without spacing between them no seam shows at segment boundaries
+		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(ImGui::GetStyle().ItemSpacing.x, 0.f));
+
+		for (std::string_view block : textData->blocks)
+		{
+			drawText(block);
+		}
+
+		ImGui::PopStyleVar();
 	}
 
 	static void drawImagePage(Tab &tab)
@@ -284,24 +305,50 @@ namespace
 	{
 		std::shared_ptr<Page> page = tab.getCurrentPage();
 
-		if (!page->isDownloaded())
+		ImGui::Dummy({0.f, ImGui::GetContentRegionAvail().y * 0.33f});
+		drawTextCentered("\"" + std::string(page->getLabel()) + "\" is being downloaded, see Downloads in the menu.");
+	}
+
+	static void drawIdentityButton(const std::shared_ptr<Page> &page, float width)
+	{
+		const float buttonWidth = 150.f;
+		const float indent = (width + buttonWidth) * 0.5f;
+
+		// one identity per capsule, scheme and authority of the URL
+		const std::string_view url = page->getUrl();
+		const size_t authorityPos = url.find("://");
+		const size_t pathPos = authorityPos != std::string_view::npos ? url.find('/', authorityPos + 3) : std::string_view::npos;
+		const std::string urlPrefix = std::string(url.substr(0, pathPos)) + '/';
+		const bool isCreating = IdentityManager::isCreating(urlPrefix);
+
+		ImGui::Spacing();
+		ImGui::Indent(indent);
+
+		if (isCreating)
 		{
-			// TODO: non-blocking call
+			ImGui::BeginDisabled();
+		}
 
-			char *savePath;
-			const char *filename = page->getLabel().data();
-			nfdresult_t result = NFD_SaveDialogU8(&savePath, nullptr, 0, nullptr, filename);
+		bool buttonClicked = ImGui::Button(isCreating ? "Creating..." : "Create Identity", {buttonWidth, 0.f});
 
-			if (result == nfdresult_t::NFD_OKAY)
-			{
-				page->download(savePath);
+		if (isCreating)
+		{
+			ImGui::EndDisabled();
+		}
 
-				NFD_FreePathU8(savePath);
-			}
-			else
-			{
-				page->download(nullptr);
-			}
+		ImGui::Unindent(indent);
+
+		if (buttonClicked)
+		{
+			IdentityManager::createAsync(std::string(extractHostName(url)), urlPrefix,
+				[pageWeakPtr = std::weak_ptr<Page>(page)](bool isCreated)
+				{
+					if (std::shared_ptr<Page> page = pageWeakPtr.lock(); page && isCreated)
+					{
+						page->load();
+					}
+				}
+			);
 		}
 	}
 
@@ -323,6 +370,11 @@ namespace
 		{
 			tab.loadCurrentPage();
 		}
+
+		if (std::shared_ptr<Page> page = tab.getCurrentPage(); page->getStatusCode() == StatusCode::CLIENT_CERTIFICATE_REQUIRED)
+		{
+			drawIdentityButton(page, width);
+		}
 	}
 
 	static void drawNewTabPage()
@@ -335,6 +387,164 @@ namespace
 		// TODO: default download path, link preview, themes, etc
 	}
 
+	static std::string formatSize(uint64_t size)
+	{
+		static constexpr const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+
+		double value = static_cast<double>(size);
+		size_t unitIndex = 0;
+
+		for (; value >= 1024.0 && unitIndex + 1 < std::size(units); unitIndex++)
+		{
+			value /= 1024.0;
+		}
+
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), unitIndex == 0 ? "%.0f %s" : "%.1f %s", value, units[unitIndex]);
+
+		return buffer;
+	}
+
+	static void drawStatisticsRow(const char *name, const char *format, ...)
+	{
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(name);
+		ImGui::TableNextColumn();
+
+		va_list args;
+		va_start(args, format);
+		ImGui::TextV(format, args);
+		va_end(args);
+	}
+
+	static void drawStatisticsPage()
+	{
+		const uint64_t pageLoadCount = statistics.pageLoadCount.load(std::memory_order_relaxed);
+		const uint64_t pageLoadTimeTotal = statistics.pageLoadTimeTotal.load(std::memory_order_relaxed);
+		const uint64_t pageLoadTimeMax = statistics.pageLoadTimeMax.load(std::memory_order_relaxed);
+		const uint64_t coalescedRequests = statistics.coalescedRequests.load(std::memory_order_relaxed);
+		const uint64_t responseCacheHits = statistics.responseCacheHits.load(std::memory_order_relaxed);
+		const uint64_t responseCacheMisses = statistics.responseCacheMisses.load(std::memory_order_relaxed);
+		const uint64_t diskCacheHits = statistics.diskCacheHits.load(std::memory_order_relaxed);
+		const uint64_t diskCacheMisses = statistics.diskCacheMisses.load(std::memory_order_relaxed);
+		const uint64_t offlineLoads = statistics.offlineLoads.load(std::memory_order_relaxed);
+		const uint64_t prefetchesStarted = statistics.prefetchesStarted.load(std::memory_order_relaxed);
+		const uint64_t prefetchesUsed = statistics.prefetchesUsed.load(std::memory_order_relaxed);
+		const uint64_t dnsCacheHits = statistics.dnsCacheHits.load(std::memory_order_relaxed);
+		const uint64_t dnsCacheMisses = statistics.dnsCacheMisses.load(std::memory_order_relaxed);
+		const uint64_t dnsPrefetches = statistics.dnsPrefetches.load(std::memory_order_relaxed);
+		const uint64_t dnsQueries = statistics.dnsQueries.load(std::memory_order_relaxed);
+		const uint64_t dnsTcpQueries = statistics.dnsTcpQueries.load(std::memory_order_relaxed);
+		const uint64_t tlsFullHandshakes = statistics.tlsFullHandshakes.load(std::memory_order_relaxed);
+		const uint64_t tlsResumedHandshakes = statistics.tlsResumedHandshakes.load(std::memory_order_relaxed);
+		const uint64_t tlsHandshakes = tlsFullHandshakes + tlsResumedHandshakes;
+		const uint64_t tlsEarlyDataAccepted = statistics.tlsEarlyDataAccepted.load(std::memory_order_relaxed);
+		const uint64_t tlsEarlyDataRejected = statistics.tlsEarlyDataRejected.load(std::memory_order_relaxed);
+		const uint64_t connectionRaceFallbacks = statistics.connectionRaceFallbacks.load(std::memory_order_relaxed);
+		const uint64_t tcpFastOpenAttempts = statistics.tcpFastOpenAttempts.load(std::memory_order_relaxed);
+		const uint64_t tcpFastOpenAccepted = statistics.tcpFastOpenAccepted.load(std::memory_order_relaxed);
+		const uint64_t preconnectsStarted = statistics.preconnectsStarted.load(std::memory_order_relaxed);
+		const uint64_t preconnectsUsed = statistics.preconnectsUsed.load(std::memory_order_relaxed);
+		const uint64_t clientRequests = statistics.clientRequests.load(std::memory_order_relaxed);
+		const uint64_t bufferPoolHits = statistics.bufferPoolHits.load(std::memory_order_relaxed);
+		const uint64_t bufferPoolLookups = bufferPoolHits + statistics.bufferPoolMisses.load(std::memory_order_relaxed);
+		const uint64_t bodyBytesCopied = statistics.bodyBytesCopied.load(std::memory_order_relaxed);
+		const uint64_t bodyBytesSpilled = statistics.bodyBytesSpilled.load(std::memory_order_relaxed);
+
+		ImGui::PushFont(fontRegular);
+
+		if (ImGui::BeginTable("Statistics", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+		{
+			drawStatisticsRow("Page loads", "%llu", static_cast<unsigned long long>(pageLoadCount));
+			drawStatisticsRow("Average page load time", "%.2f ms", pageLoadCount > 0 ? pageLoadTimeTotal / 1000.0 / pageLoadCount : 0.0);
+			drawStatisticsRow("Maximum page load time", "%.2f ms", pageLoadTimeMax / 1000.0);
+			drawStatisticsRow("Loads joined to a request in flight", "%llu", static_cast<unsigned long long>(coalescedRequests));
+			drawStatisticsRow("Response cache (hits / misses)", "%llu / %llu", static_cast<unsigned long long>(responseCacheHits), static_cast<unsigned long long>(responseCacheMisses));
+			drawStatisticsRow("Response cache size", "%s / %s", formatSize(ResponseCache::getSize()).c_str(), formatSize(ResponseCache::getCapacity()).c_str());
+			drawStatisticsRow("Disk cache (hits / misses)", "%llu / %llu", static_cast<unsigned long long>(diskCacheHits), static_cast<unsigned long long>(diskCacheMisses));
+			drawStatisticsRow("Pages served offline", "%llu", static_cast<unsigned long long>(offlineLoads));
+			drawStatisticsRow("Prefetched pages (loaded / opened)", "%llu / %llu", static_cast<unsigned long long>(prefetchesStarted), static_cast<unsigned long long>(prefetchesUsed));
+			drawStatisticsRow("DNS cache (hits / misses)", "%llu / %llu", static_cast<unsigned long long>(dnsCacheHits), static_cast<unsigned long long>(dnsCacheMisses));
+			drawStatisticsRow("DNS prefetches", "%llu", static_cast<unsigned long long>(dnsPrefetches));
+			drawStatisticsRow("DNS queries (UDP / TCP)", "%llu / %llu", static_cast<unsigned long long>(dnsQueries), static_cast<unsigned long long>(dnsTcpQueries));
+			drawStatisticsRow("TLS handshakes (full / resumed)", "%llu / %llu", static_cast<unsigned long long>(tlsFullHandshakes), static_cast<unsigned long long>(tlsResumedHandshakes));
+			drawStatisticsRow("TLS session resumption rate", "%.1f %%", tlsHandshakes > 0 ? 100.0 * tlsResumedHandshakes / tlsHandshakes : 0.0);
+			drawStatisticsRow("TLS early data (accepted / rejected)", "%llu / %llu", static_cast<unsigned long long>(tlsEarlyDataAccepted), static_cast<unsigned long long>(tlsEarlyDataRejected));
+			drawStatisticsRow("Connections through a fallback address", "%llu", static_cast<unsigned long long>(connectionRaceFallbacks));
+			drawStatisticsRow("TCP Fast Open (attempted / accepted)", "%llu / %llu", static_cast<unsigned long long>(tcpFastOpenAttempts), static_cast<unsigned long long>(tcpFastOpenAccepted));
+			drawStatisticsRow("Preconnections on hover (started / used)", "%llu / %llu", static_cast<unsigned long long>(preconnectsStarted), static_cast<unsigned long long>(preconnectsUsed));
+			drawStatisticsRow("Preconnection hit rate", "%.1f %%", preconnectsStarted > 0 ? 100.0 * preconnectsUsed / preconnectsStarted : 0.0);
+			drawStatisticsRow("Requests", "%llu", static_cast<unsigned long long>(clientRequests));
+			drawStatisticsRow("Buffer pool hit rate", "%.1f %%", bufferPoolLookups > 0 ? 100.0 * bufferPoolHits / bufferPoolLookups : 0.0);
+			drawStatisticsRow("Body bytes copied per request", "%s", formatSize(clientRequests > 0 ? bodyBytesCopied / clientRequests : 0).c_str());
+			drawStatisticsRow("Body bytes written to temp files", "%s", formatSize(bodyBytesSpilled).c_str());
+#if defined(GEM_IO_URING)
+			drawStatisticsRow("I/O backend", "%s", "io_uring");
+#endif
+#if defined(GEM_COUNT_ALLOCATIONS)
+			const uint64_t networkAllocations = statistics.networkAllocations.load(std::memory_order_relaxed);
+			drawStatisticsRow("Network thread allocations per request", "%.1f", clientRequests > 0 ? static_cast<double>(networkAllocations) / clientRequests : 0.0);
+#endif
+
+			ImGui::EndTable();
+		}
+
+		ImGui::PopFont();
+	}
+
+	static void drawDownloadsPage()
+	{
+		static constexpr const char *stateNames[] = {"Choosing location", "Downloading", "Completed", "Failed", "Cancelled"};
+
+		const std::vector<std::shared_ptr<Download>> &downloads = DownloadManager::getDownloads();
+
+		ImGui::PushFont(fontRegular);
+
+		if (downloads.empty())
+		{
+			ImGui::TextUnformatted("No downloads.");
+		}
+		else if (ImGui::BeginTable("Downloads", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+		{
+			for (const std::shared_ptr<Download> &download : downloads)
+			{
+				const DownloadState state = download->state.load();
+
+				ImGui::PushID(download.get());
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(download->fileName.c_str());
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(formatSize(download->bytesReceived).c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%s/s", formatSize(download->bytesPerSecond).c_str());
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(stateNames[static_cast<size_t>(state)]);
+				ImGui::TableNextColumn();
+
+				if (state == DownloadState::ChoosingPath || state == DownloadState::Receiving)
+				{
+					if (ImGui::SmallButton("Cancel"))
+					{
+						DownloadManager::cancel(download);
+					}
+				}
+
+				ImGui::PopID();
+			}
+
+			ImGui::EndTable();
+
+			if (ImGui::Button("Clear Finished"))
+			{
+				DownloadManager::removeFinished();
+			}
+		}
+
+		ImGui::PopFont();
+	}
+
 	static void drawPage(std::vector<Tab> &tabs, uint32_t currentTabIndex)
 	{
 		Tab &tab = tabs[currentTabIndex];
@@ -370,6 +580,12 @@ namespace
 				case PageType::Settings:
 					drawSettingsPage();
 					break;
+				case PageType::Statistics:
+					drawStatisticsPage();
+					break;
+				case PageType::Downloads:
+					drawDownloadsPage();
+					break;
 				default:
 					assert(false);
 			}
@@ -450,6 +666,18 @@ namespace
 			{
 				// TODO: settings tab
 			}
+			if (ImGui::MenuItem("Downloads"))
+			{
+				Tab newTab;
+				newTab.loadNewPage(std::make_shared<Page>(Page::downloadsPage));
+				tabs.push_back(newTab);
+			}
+			if (ImGui::MenuItem("Statistics"))
+			{
+				Tab newTab;
+				newTab.loadNewPage(std::make_shared<Page>(Page::statisticsPage));
+				tabs.push_back(newTab);
+			}
 			if (ImGui::MenuItem("About"))
 			{
 				// TODO: about page
@@ -504,7 +732,7 @@ namespace
 
 		std::shared_ptr<Page> page = tab.getCurrentPage();
 
-		if (PageType pageType = page->getPageType(); pageType == PageType::NewTab || pageType == PageType::Settings)
+		if (PageType pageType = page->getPageType(); pageType == PageType::NewTab || pageType == PageType::Settings || pageType == PageType::Statistics || pageType == PageType::Downloads)
 		{
 			ImGui::BeginDisabled();
 			ImGui::Button(ICON_FA_REPEAT, toolbarButtonSize);
@@ -514,14 +742,14 @@ namespace
 		{
 			if (ImGui::Button(ICON_FA_REPEAT, toolbarButtonSize))
 			{
-				tab.loadCurrentPage();
+				tab.reloadCurrentPage();
 			}
 		}
 		else
 		{
 			if (ImGui::Button(ICON_FA_TIMES, toolbarButtonSize))
 			{
-				// TODO: cancellation
+				page->cancel();
 			}
 		}
 		ImGui::SameLine();
@@ -573,7 +801,7 @@ namespace
 
 			if (ImGui::MenuItem("Reload Tab"))
 			{
-				tab.loadCurrentPage();
+				tab.reloadCurrentPage();
 			}
 			if (ImGui::MenuItem("Duplicate Tab"))
 			{
@@ -680,6 +908,7 @@ namespace
 			ImGui::PopFont();
 
 			tabs[i].setOpen(isOpen);
+			page->setPriority(isTabSelected ? RequestPriority::Foreground : RequestPriority::Background);
 
 			drawTabMenu(userData, tabs, i, forceSelectedTabIndex, tabsToRemoveIndices);
 
@@ -0,0 +1,195 @@
+#include "Body.hpp"
+#include "Statistics.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+	#include <io.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+using namespace gem;
+
+std::atomic<size_t> Body::_spillThreshold {Body::defaultSpillThreshold};
+
+Body::~Body()
+{
+	for (char *extent : _extents)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(extent);
+#else
+		munmap(extent, extentSize);
+#endif
+	}
+
+	if (_spillFile != nullptr)
+	{
+		fclose(_spillFile); // the temp file is removed with its last handle
+	}
+}
+
+void Body::setSpillThreshold(size_t threshold)
+{
+	_spillThreshold.store(threshold, std::memory_order_relaxed);
+}
+
+void Body::append(const char *data, size_t size)
+{
+	while (size > 0)
+	{
+		size_t available = size;
+		char *space = prepare(available);
+
+		memcpy(space, data, available);
+		commit(available);
+
+		data += available;
+		size -= available;
+	}
+}
+
+char *Body::prepare(size_t &size)
+{
+	if (capacity() == _size)
+	{
+		const size_t index = _segments.size();
+		const size_t spillThreshold = _spillThreshold.load(std::memory_order_relaxed);
+		// growing segments are too small to be worth mapping
+		const bool spills = _canSpill && spillThreshold > 0 && _size >= spillThreshold && index >= growingSegmentCount;
+		char *segment = spills ? mapSpillSegment() : nullptr;
+		_isLastSegmentMapped = segment != nullptr;
+
+		if (segment != nullptr)
+		{
+			_mappedSegmentCount++;
+		}
+		else
+		{
+			segment = _heapSegments.emplace_back(new char[getSegmentCapacity(index)]).get();
+		}
+
+		_segments.push_back(segment);
+	}
+
+	const size_t offset = _size - getSegmentStart(_segments.size() - 1);
+	size = std::min(size, getSegmentCapacity(_segments.size() - 1) - offset);
+
+	return _segments.back() + offset;
+}
+
+void Body::commit(size_t size)
+{
+	_size += size;
+
+	if (_isLastSegmentMapped)
+	{
+		statistics.bodyBytesSpilled.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+char *Body::mapSpillSegment()
+{
+	// heap segments are kept, views into them must stay valid
+	const size_t segmentsPerExtent = extentSize / segmentSize;
+
+	if (_mappedSegmentCount % segmentsPerExtent != 0)
+	{
+		return _extents.back() + (_mappedSegmentCount % segmentsPerExtent) * segmentSize;
+	}
+
+	if (_spillFile == nullptr && (_spillFile = tmpfile()) == nullptr)
+	{
+		_canSpill = false;
+		return nullptr;
+	}
+
+	const uint64_t offset = static_cast<uint64_t>(_extents.size()) * extentSize;
+	void *extent = nullptr;
+
+#if defined(_WIN32)
+	HANDLE file = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(_spillFile)));
+	const uint64_t fileSize = offset + extentSize;
+
+	// the file is extended to the mapping size
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(fileSize >> 32), static_cast<DWORD>(fileSize), nullptr);
+
+	if (mapping != nullptr)
+	{
+		extent = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), extentSize);
+		CloseHandle(mapping);
+	}
+#else
+	const int file = fileno(_spillFile);
+
+#if defined(__linux__)
+	// blocks are reserved up front, a full disk fails here instead of faulting on a write to the mapping
+	const bool isExtended = posix_fallocate(file, static_cast<off_t>(offset), static_cast<off_t>(extentSize)) == 0;
+#else
+	const bool isExtended = ftruncate(file, static_cast<off_t>(offset + extentSize)) == 0;
+#endif
+
+	if (isExtended)
+	{
+		extent = mmap(nullptr, extentSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, static_cast<off_t>(offset));
+		extent = extent != MAP_FAILED ? extent : nullptr;
+	}
+#endif
+
+	if (extent == nullptr)
+	{
+		fprintf(stderr, "Failed to map a temp file for a response body, keeping it in memory\n");
+		_canSpill = false;
+		return nullptr;
+	}
+
+	return _extents.emplace_back(static_cast<char *>(extent));
+}
+
+std::string_view Body::getSegment(size_t index) const
+{
+	const size_t start = getSegmentStart(index);
+
+	return std::string_view(_segments[index], std::min(_size - start, getSegmentCapacity(index)));
+}
+
+void Body::copy(size_t offset, size_t size, char *destination) const
+{
+	while (size > 0)
+	{
+		const size_t index = getSegmentIndex(offset);
+		const size_t segmentOffset = offset - getSegmentStart(index);
+		const size_t count = std::min(size, getSegmentCapacity(index) - segmentOffset);
+
+		memcpy(destination, _segments[index] + segmentOffset, count);
+
+		offset += count;
+		destination += count;
+		size -= count;
+	}
+}
+
+std::string_view Body::view(size_t offset, size_t size, std::deque<std::string> &storage) const
+{
+	if (size == 0)
+	{
+		return {};
+	}
+
+	if (const size_t index = getSegmentIndex(offset); index == getSegmentIndex(offset + size - 1))
+	{
+		return std::string_view(_segments[index] + (offset - getSegmentStart(index)), size);
+	}
+
+	std::string &joined = storage.emplace_back(size, '\0');
+	copy(offset, size, joined.data());
+
+	return joined;
+}
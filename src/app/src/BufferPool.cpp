@@ -0,0 +1,154 @@
+#include "BufferPool.hpp"
+#include "Statistics.hpp"
+
+#include <array>
+#include <mutex>
+#include <new>
+
+using namespace gem;
+
+namespace
+{
+	static constexpr size_t blockClassCount = 7; // 64 B .. 4 KB
+	static constexpr size_t bufferClassCount = 7; // 1 KB .. 64 KB
+
+	struct SizeClass
+	{
+		std::mutex mutex;
+		std::vector<void *> blocks;
+		std::vector<Buffer *> buffers;
+	};
+
+	struct Pool
+	{
+		std::array<SizeClass, blockClassCount> blockClasses;
+		std::array<SizeClass, bufferClassCount> bufferClasses;
+	};
+
+	// never destroyed, memory may still be released by other static objects during exit
+	static Pool &getPool()
+	{
+		static Pool *pool = new Pool();
+		return *pool;
+	}
+
+	static size_t getClassIndex(size_t size, size_t minSize)
+	{
+		size_t index = 0;
+
+		for (size_t classSize = minSize; classSize < size; classSize *= 2)
+		{
+			index++;
+		}
+
+		return index;
+	}
+
+	static void recordLookup(bool isHit)
+	{
+		(isHit ? statistics.bufferPoolHits : statistics.bufferPoolMisses).fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void *BufferPool::allocate(size_t size)
+{
+	if (size > maxBlockSize)
+	{
+		return ::operator new(size);
+	}
+
+	const size_t index = getClassIndex(size, minBlockSize);
+	SizeClass &sizeClass = getPool().blockClasses[index];
+
+	{
+		std::lock_guard lock(sizeClass.mutex);
+
+		if (!sizeClass.blocks.empty())
+		{
+			void *ptr = sizeClass.blocks.back();
+			sizeClass.blocks.pop_back();
+			recordLookup(true);
+
+			return ptr;
+		}
+	}
+
+	recordLookup(false);
+
+	return ::operator new(minBlockSize << index);
+}
+
+void BufferPool::deallocate(void *ptr, size_t size)
+{
+	if (size > maxBlockSize)
+	{
+		::operator delete(ptr);
+		return;
+	}
+
+	const size_t index = getClassIndex(size, minBlockSize);
+	SizeClass &sizeClass = getPool().blockClasses[index];
+
+	{
+		std::lock_guard lock(sizeClass.mutex);
+
+		if (sizeClass.blocks.size() < maxCachedBytes / (minBlockSize << index))
+		{
+			sizeClass.blocks.push_back(ptr);
+			return;
+		}
+	}
+
+	::operator delete(ptr);
+}
+
+std::shared_ptr<Buffer> BufferPool::acquireBuffer(size_t capacity)
+{
+	Buffer *buffer = nullptr;
+	const size_t index = getClassIndex(capacity, minBufferCapacity);
+
+	if (index < bufferClassCount)
+	{
+		SizeClass &sizeClass = getPool().bufferClasses[index];
+		std::lock_guard lock(sizeClass.mutex);
+
+		if (!sizeClass.buffers.empty())
+		{
+			buffer = sizeClass.buffers.back();
+			sizeClass.buffers.pop_back();
+		}
+	}
+
+	recordLookup(buffer != nullptr);
+
+	if (buffer == nullptr)
+	{
+		buffer = new Buffer();
+		buffer->reserve(index < bufferClassCount ? minBufferCapacity << index : capacity);
+	}
+
+	return std::shared_ptr<Buffer>(buffer,
+		[](Buffer *buffer)
+		{
+			// the capacity may have grown past its class, it is filed under the class it fully covers
+			size_t index = getClassIndex(buffer->capacity() + 1, minBufferCapacity);
+			index = index > 0 ? index - 1 : 0;
+
+			if (buffer->capacity() >= minBufferCapacity && index < bufferClassCount)
+			{
+				SizeClass &sizeClass = getPool().bufferClasses[index];
+				std::lock_guard lock(sizeClass.mutex);
+
+				if (sizeClass.buffers.size() < maxCachedBytes / (minBufferCapacity << index))
+				{
+					buffer->clear();
+					sizeClass.buffers.push_back(buffer);
+					return;
+				}
+			}
+
+			delete buffer;
+		},
+		PoolAllocator<char>()
+	);
+}
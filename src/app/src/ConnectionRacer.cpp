@@ -0,0 +1,184 @@
+#include "ConnectionRacer.hpp"
+#include "Statistics.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <asio/error.hpp>
+
+using namespace gem;
+
+std::unordered_map<std::string, ConnectionRacer::Winner> ConnectionRacer::_winners;
+
+ConnectionRacer::ConnectionRacer(const asio::any_io_executor &executor, std::string hostName, const asio::ip::tcp::resolver::results_type &endpoints, SocketOpener opener) :
+	_executor {executor},
+	_hostName {std::move(hostName)},
+	_opener {std::move(opener)},
+	_timer {executor}
+{
+	std::vector<asio::ip::tcp::endpoint> ipv6Endpoints, ipv4Endpoints;
+
+	for (const auto &entry : endpoints)
+	{
+		(entry.endpoint().address().is_v6() ? ipv6Endpoints : ipv4Endpoints).push_back(entry.endpoint());
+	}
+
+	// IPv6 goes first unless IPv4 won the previous race for this host
+	bool preferIpv4 = false;
+
+	if (auto it = _winners.find(_hostName); it != _winners.end() && it->second.expirationTime > std::chrono::steady_clock::now())
+	{
+		preferIpv4 = it->second.isIpv4;
+		_hasKnownFamily = !(preferIpv4 ? ipv4Endpoints : ipv6Endpoints).empty();
+	}
+
+	const std::vector<asio::ip::tcp::endpoint> &first = preferIpv4 ? ipv4Endpoints : ipv6Endpoints;
+	const std::vector<asio::ip::tcp::endpoint> &second = preferIpv4 ? ipv6Endpoints : ipv4Endpoints;
+
+	_endpoints.reserve(first.size() + second.size());
+
+	for (size_t i = 0; i < std::max(first.size(), second.size()); i++)
+	{
+		if (i < first.size())
+		{
+			_endpoints.push_back(first[i]);
+		}
+
+		if (i < second.size())
+		{
+			_endpoints.push_back(second[i]);
+		}
+	}
+
+	_sockets.reserve(_endpoints.size()); // pending operations must not be moved
+}
+
+void ConnectionRacer::start(RaceCallback callback)
+{
+	_callback = std::move(callback);
+
+	if (_endpoints.empty())
+	{
+		_isFinished = true;
+		_callback(asio::error::host_not_found, asio::ip::tcp::socket(_executor));
+		return;
+	}
+
+	startNextAttempt();
+}
+
+void ConnectionRacer::cancel()
+{
+	if (_isFinished)
+	{
+		return;
+	}
+
+	_nextAttemptIndex = _endpoints.size(); // no further attempts
+	_timer.cancel();
+
+	for (asio::ip::tcp::socket &socket : _sockets)
+	{
+		asio::error_code ignored;
+		socket.close(ignored);
+	}
+}
+
+void ConnectionRacer::startNextAttempt()
+{
+	const size_t index = _nextAttemptIndex++;
+	const asio::ip::tcp::endpoint &endpoint = _endpoints[index];
+	asio::ip::tcp::socket &socket = _sockets.emplace_back(_executor);
+
+	_opener(socket, endpoint, _endpoints.size() == 1 || (index == 0 && _hasKnownFamily));
+	_pendingAttempts++;
+
+	socket.async_connect(endpoint,
+		[self = shared_from_this(), index](const asio::error_code &ec)
+		{
+			self->finishAttempt(index, ec);
+		}
+	);
+
+	if (_nextAttemptIndex < _endpoints.size())
+	{
+		_timer.expires_after(attemptDelay); // cancels the previous wait
+		_timer.async_wait(
+			[self = shared_from_this()](const asio::error_code &ec)
+			{
+				if (!ec && !self->_isFinished && self->_nextAttemptIndex < self->_endpoints.size())
+				{
+					self->startNextAttempt();
+				}
+			}
+		);
+	}
+}
+
+void ConnectionRacer::finishAttempt(size_t index, const asio::error_code &ec)
+{
+	_pendingAttempts--;
+
+	if (_isFinished)
+	{
+		return;
+	}
+
+	if (!ec)
+	{
+		_isFinished = true;
+		_timer.cancel();
+
+		for (size_t i = 0; i < _sockets.size(); i++)
+		{
+			if (i != index)
+			{
+				asio::error_code ignored;
+				_sockets[i].close(ignored);
+			}
+		}
+
+		storeWinner(_hostName, _endpoints[index].address().is_v4());
+
+		if (index > 0)
+		{
+			statistics.connectionRaceFallbacks.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		_callback(ec, std::move(_sockets[index]));
+		return;
+	}
+
+	_lastError = ec;
+
+	if (_nextAttemptIndex < _endpoints.size())
+	{
+		startNextAttempt(); // do not wait for the delay after a failure
+	}
+	else if (_pendingAttempts == 0)
+	{
+		_isFinished = true;
+		_timer.cancel();
+		_callback(_lastError, asio::ip::tcp::socket(_executor));
+	}
+}
+
+void ConnectionRacer::storeWinner(const std::string &hostName, bool isIpv4)
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	if (_winners.size() >= _maxWinners && _winners.find(hostName) == _winners.end())
+	{
+		for (auto it = _winners.begin(); it != _winners.end();)
+		{
+			it = it->second.expirationTime <= now ? _winners.erase(it) : std::next(it);
+		}
+
+		if (_winners.size() >= _maxWinners)
+		{
+			return; // every entry is fresh, the host races without a preference
+		}
+	}
+
+	_winners[hostName] = {isIpv4, now + familyTtl};
+}
@@ -0,0 +1,68 @@
+#include "Deadline.hpp"
+#include "BufferPool.hpp"
+
+#include <asio/post.hpp>
+
+using namespace gem;
+
+Deadline::Deadline(const asio::any_io_executor &executor) : _timer {executor}
+{
+}
+
+void Deadline::startPhase(std::chrono::milliseconds timeout, InterruptHandler interrupt)
+{
+	finishPhase();
+	_interrupt = std::move(interrupt);
+
+	if (isExpired())
+	{
+		// cancelled between two phases, stop right away
+		asio::post(_timer.get_executor(), [self = shared_from_this(), phase = _phase]() { self->expire(phase, self->_reason); });
+		return;
+	}
+
+	if (timeout.count() > 0)
+	{
+		_timer.expires_after(timeout);
+		_timer.async_wait(bindPoolAllocator(
+			[self = shared_from_this(), phase = _phase](const asio::error_code &ec)
+			{
+				if (!ec)
+				{
+					self->expire(phase, Reason::TimedOut);
+				}
+			}
+		));
+	}
+}
+
+void Deadline::finishPhase()
+{
+	_phase++; // expiries already queued for the old phase are ignored
+	_interrupt = nullptr;
+	_timer.cancel();
+}
+
+void Deadline::cancel()
+{
+	expire(_phase, Reason::Cancelled);
+}
+
+void Deadline::expire(uint32_t phase, Reason reason)
+{
+	if (phase != _phase)
+	{
+		return;
+	}
+
+	if (_reason == Reason::None)
+	{
+		_reason = reason;
+	}
+
+	if (InterruptHandler interrupt = std::move(_interrupt))
+	{
+		_interrupt = nullptr;
+		interrupt();
+	}
+}
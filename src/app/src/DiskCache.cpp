@@ -0,0 +1,514 @@
+#include "DiskCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <vector>
+
+#include <asio/post.hpp>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace gem;
+
+namespace
+{
+	static constexpr uint32_t indexMagic = 0x58444d47; // "GMDX"
+	static constexpr uint32_t indexVersion = 1;
+	static constexpr uint32_t slotCount = 8192;
+	static constexpr uint32_t maxEntryCount = slotCount / 4 * 3; // keeps probe sequences short
+	static constexpr size_t maxMetaSize = 96; // responses with a longer meta are not stored
+
+	static uint64_t hashUrl(std::string_view url)
+	{
+		uint64_t hash = 14695981039346656037ull; // FNV-1a
+
+		for (unsigned char c : url)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+
+		return hash != 0 ? hash : 1; // 0 marks an empty slot
+	}
+
+	// fseek and ftell take a long, which is 32 bits on Windows
+	static bool seekBlob(FILE *file, uint64_t offset, int origin = SEEK_SET)
+	{
+#if defined(_WIN32)
+		return _fseeki64(file, static_cast<int64_t>(offset), origin) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+	}
+
+	static int64_t tellBlob(FILE *file)
+	{
+#if defined(_WIN32)
+		return _ftelli64(file);
+#else
+		return static_cast<int64_t>(ftello(file));
+#endif
+	}
+
+	static int64_t getCurrentTime()
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+}
+
+// Both structures are stored as they are in the index file
+struct DiskCache::IndexHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t entryCount;
+	uint32_t generation; // of the blob file in use
+	uint32_t reserved;
+	uint64_t blobSize;
+	uint64_t liveSize; // bytes of records still referenced by the index
+};
+
+struct DiskCache::IndexEntry
+{
+	uint64_t hash; // 0 = empty slot
+	uint64_t offset; // of the record (URL followed by the body) in the blob file
+	int64_t fetchTime; // seconds since the epoch
+	uint32_t bodySize;
+	uint16_t urlSize;
+	uint8_t statusCode;
+	uint8_t metaSize;
+	char meta[maxMetaSize];
+};
+
+std::optional<asio::thread_pool> DiskCache::_fileThread;
+LockFreeQueue<std::function<void()>> DiskCache::_completions;
+std::string DiskCache::_directory;
+size_t DiskCache::_capacity = 0;
+DiskCache::IndexHeader *DiskCache::_header = nullptr;
+DiskCache::IndexEntry *DiskCache::_entries = nullptr;
+size_t DiskCache::_indexSize = sizeof(IndexHeader) + slotCount * sizeof(IndexEntry);
+FILE *DiskCache::_blobFile = nullptr;
+
+void DiskCache::open(std::string directory, size_t capacity)
+{
+	if (capacity == 0 || _fileThread)
+	{
+		return;
+	}
+
+	_fileThread.emplace(1);
+
+	asio::post(*_fileThread,
+		[directory = std::move(directory), capacity]()
+		{
+			_directory = directory;
+			_capacity = capacity;
+
+			std::error_code ec;
+			std::filesystem::create_directories(_directory, ec);
+
+			if (!mapIndex((std::filesystem::path(_directory) / "index").string()))
+			{
+				fprintf(stderr, "Failed to open the disk cache in \"%s\"\n", _directory.c_str());
+				return;
+			}
+
+			bool isValid = _header->magic == indexMagic && _header->version == indexVersion && _header->slotCount == slotCount;
+
+			if (isValid)
+			{
+				std::remove(getBlobPath(_header->generation + 1).c_str()); // left over by an interrupted compaction
+				_blobFile = fopen(getBlobPath(_header->generation).c_str(), "r+b");
+
+				// records past the end of a shorter file would be unreadable
+				isValid = _blobFile != nullptr && seekBlob(_blobFile, 0, SEEK_END) && tellBlob(_blobFile) >= static_cast<int64_t>(_header->blobSize);
+			}
+
+			if (!isValid)
+			{
+				if (_blobFile != nullptr)
+				{
+					fclose(_blobFile);
+				}
+
+				memset(static_cast<void *>(_header), 0, _indexSize);
+				_header->magic = indexMagic;
+				_header->version = indexVersion;
+				_header->slotCount = slotCount;
+				_blobFile = fopen(getBlobPath(0).c_str(), "w+b");
+			}
+
+			if (_blobFile == nullptr)
+			{
+				fprintf(stderr, "Failed to open the disk cache in \"%s\"\n", _directory.c_str());
+				unmapIndex();
+			}
+		}
+	);
+}
+
+void DiskCache::close()
+{
+	if (!_fileThread)
+	{
+		return;
+	}
+
+	asio::post(*_fileThread,
+		[]()
+		{
+			if (_blobFile != nullptr)
+			{
+				fclose(_blobFile);
+				_blobFile = nullptr;
+			}
+
+			unmapIndex();
+		}
+	);
+
+	_fileThread->join(); // pending writes are finished first
+	_fileThread.reset();
+}
+
+void DiskCache::loadAsync(std::string url, std::chrono::seconds maxAge, LoadCallback callback)
+{
+	if (!_fileThread)
+	{
+		_completions.push([callback = std::move(callback)]() { callback(std::nullopt); }); // disabled
+		return;
+	}
+
+	asio::post(*_fileThread,
+		[url = std::move(url), maxAge, callback = std::move(callback)]()
+		{
+			std::optional<CachedResponse> response = load(url, maxAge);
+			_completions.push([callback, response = std::move(response)]() { callback(response); });
+		}
+	);
+}
+
+void DiskCache::store(std::string url, CachedResponse response)
+{
+	if (!_fileThread)
+	{
+		return;
+	}
+
+	asio::post(*_fileThread, [url = std::move(url), response = std::move(response)]() { write(url, response); });
+}
+
+void DiskCache::poll()
+{
+	for (std::function<void()> handler; _completions.pop(handler);)
+	{
+		handler();
+	}
+}
+
+std::optional<CachedResponse> DiskCache::load(const std::string &url, std::chrono::seconds maxAge)
+{
+	if (_header == nullptr)
+	{
+		return std::nullopt;
+	}
+
+	const uint64_t hash = hashUrl(url);
+	const IndexEntry *entry = findSlot(hash);
+
+	if (entry->hash != hash || (maxAge.count() > 0 && getCurrentTime() - entry->fetchTime > maxAge.count()))
+	{
+		return std::nullopt;
+	}
+
+	std::string recordUrl(entry->urlSize, '\0');
+
+	if (!seekBlob(_blobFile, entry->offset) ||
+		fread(recordUrl.data(), 1, recordUrl.size(), _blobFile) != recordUrl.size() ||
+		recordUrl != url) // hash collision
+	{
+		return std::nullopt;
+	}
+
+	auto body = std::make_shared<Body>();
+
+	for (size_t remaining = entry->bodySize; remaining > 0;)
+	{
+		size_t size = remaining;
+		char *space = body->prepare(size);
+
+		if (fread(space, 1, size, _blobFile) != size)
+		{
+			return std::nullopt;
+		}
+
+		body->commit(size);
+		remaining -= size;
+	}
+
+	return CachedResponse {static_cast<StatusCode>(entry->statusCode), std::string(entry->meta, entry->metaSize), std::move(body)};
+}
+
+void DiskCache::write(const std::string &url, const CachedResponse &response)
+{
+	if (_header == nullptr || response.meta.size() > maxMetaSize || url.size() > std::numeric_limits<uint16_t>::max())
+	{
+		return;
+	}
+
+	const size_t recordSize = url.size() + response.body->size();
+
+	if (recordSize > _capacity / 4 || response.body->size() > std::numeric_limits<uint32_t>::max())
+	{
+		return; // not worth evicting a quarter of the cache
+	}
+
+	if (_header->blobSize + recordSize > _capacity || _header->entryCount >= maxEntryCount)
+	{
+		compact(_capacity / 2, maxEntryCount / 2);
+
+		if (_header == nullptr)
+		{
+			return;
+		}
+	}
+
+	if (!seekBlob(_blobFile, 0, SEEK_END))
+	{
+		return;
+	}
+
+	const int64_t offset = tellBlob(_blobFile);
+
+	bool isWritten = offset >= 0 && fwrite(url.data(), 1, url.size(), _blobFile) == url.size();
+
+	for (size_t i = 0; isWritten && i < response.body->getSegmentCount(); i++)
+	{
+		const std::string_view segment = response.body->getSegment(i);
+		isWritten = fwrite(segment.data(), 1, segment.size(), _blobFile) == segment.size();
+	}
+
+	if (!isWritten || fflush(_blobFile) != 0)
+	{
+		fprintf(stderr, "Failed to write the disk cache in \"%s\"\n", _directory.c_str());
+		return;
+	}
+
+	const uint64_t hash = hashUrl(url);
+	IndexEntry *entry = findSlot(hash);
+
+	if (entry->hash == hash)
+	{
+		_header->liveSize -= entry->urlSize + entry->bodySize; // replaced, the old record is garbage now
+	}
+	else
+	{
+		_header->entryCount++;
+	}
+
+	entry->hash = hash;
+	entry->offset = static_cast<uint64_t>(offset);
+	entry->fetchTime = getCurrentTime();
+	entry->bodySize = static_cast<uint32_t>(response.body->size());
+	entry->urlSize = static_cast<uint16_t>(url.size());
+	entry->statusCode = static_cast<uint8_t>(response.statusCode);
+	entry->metaSize = static_cast<uint8_t>(response.meta.size());
+	memcpy(entry->meta, response.meta.data(), response.meta.size());
+
+	_header->blobSize = static_cast<uint64_t>(offset) + recordSize;
+	_header->liveSize += recordSize;
+}
+
+DiskCache::IndexEntry *DiskCache::findSlot(uint64_t hash)
+{
+	// linear probing, the index is never full
+	for (uint32_t i = hash % slotCount;; i = (i + 1) % slotCount)
+	{
+		if (_entries[i].hash == hash || _entries[i].hash == 0)
+		{
+			return &_entries[i];
+		}
+	}
+}
+
+void DiskCache::compact(size_t targetSize, uint32_t targetCount)
+{
+	std::vector<IndexEntry> entries;
+	entries.reserve(_header->entryCount);
+
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		if (_entries[i].hash != 0)
+		{
+			entries.push_back(_entries[i]);
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const IndexEntry &a, const IndexEntry &b) { return a.fetchTime > b.fetchTime; });
+
+	const uint32_t generation = _header->generation + 1;
+	const std::string path = getBlobPath(generation);
+	FILE *file = fopen(path.c_str(), "w+b");
+
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Failed to compact the disk cache in \"%s\"\n", _directory.c_str());
+		fclose(_blobFile);
+		_blobFile = nullptr;
+		unmapIndex();
+		return;
+	}
+
+	// the most recently fetched records are copied until the target is reached
+	std::vector<IndexEntry> keptEntries;
+	std::vector<char> record;
+	uint64_t size = 0;
+
+	for (IndexEntry &entry : entries)
+	{
+		const size_t recordSize = entry.urlSize + entry.bodySize;
+
+		if (size + recordSize > targetSize || keptEntries.size() == targetCount)
+		{
+			break;
+		}
+
+		record.resize(recordSize);
+
+		if (!seekBlob(_blobFile, entry.offset) || fread(record.data(), 1, record.size(), _blobFile) != record.size())
+		{
+			continue; // unreadable records are dropped
+		}
+
+		if (fwrite(record.data(), 1, record.size(), file) != record.size())
+		{
+			// rather start empty than grow past the budget
+			fclose(file);
+			file = fopen(path.c_str(), "w+b");
+			keptEntries.clear();
+			size = 0;
+			break;
+		}
+
+		entry.offset = size;
+		size += recordSize;
+		keptEntries.push_back(entry);
+	}
+
+	if (file == nullptr || fflush(file) != 0)
+	{
+		fprintf(stderr, "Failed to compact the disk cache in \"%s\"\n", _directory.c_str());
+
+		if (file != nullptr)
+		{
+			fclose(file);
+		}
+
+		fclose(_blobFile);
+		_blobFile = nullptr;
+		unmapIndex();
+		return;
+	}
+
+	memset(static_cast<void *>(_entries), 0, slotCount * sizeof(IndexEntry));
+
+	for (const IndexEntry &entry : keptEntries)
+	{
+		*findSlot(entry.hash) = entry;
+	}
+
+	_header->entryCount = static_cast<uint32_t>(keptEntries.size());
+	_header->blobSize = size;
+	_header->liveSize = size;
+	_header->generation = generation;
+
+	fclose(_blobFile);
+	std::remove(getBlobPath(generation - 1).c_str());
+	_blobFile = file;
+}
+
+bool DiskCache::mapIndex(const std::string &path)
+{
+	void *data = nullptr;
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	// a smaller file is extended to the mapping size
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(_indexSize), nullptr);
+
+	if (mapping != nullptr)
+	{
+		data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, _indexSize);
+		CloseHandle(mapping);
+	}
+
+	CloseHandle(file);
+#else
+	int file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+
+	if (fstat(file, &fileStat) == 0 && (static_cast<size_t>(fileStat.st_size) == _indexSize || ftruncate(file, static_cast<off_t>(_indexSize)) == 0))
+	{
+		data = mmap(nullptr, _indexSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		data = data != MAP_FAILED ? data : nullptr;
+	}
+
+	::close(file); // the mapping stays valid
+#endif
+
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	_header = static_cast<IndexHeader *>(data);
+	_entries = reinterpret_cast<IndexEntry *>(static_cast<char *>(data) + sizeof(IndexHeader));
+
+	return true;
+}
+
+void DiskCache::unmapIndex()
+{
+	if (_header == nullptr)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(_header);
+#else
+	munmap(_header, _indexSize);
+#endif
+
+	_header = nullptr;
+	_entries = nullptr;
+}
+
+std::string DiskCache::getBlobPath(uint32_t generation)
+{
+	return (std::filesystem::path(_directory) / ("blobs." + std::to_string(generation))).string();
+}
@@ -0,0 +1,724 @@
+#include "DnsResolver.hpp"
+#include "Statistics.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include <asio/connect.hpp>
+#include <asio/error.hpp>
+#include <asio/post.hpp>
+#include <asio/read.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/write.hpp>
+
+using namespace gem;
+
+namespace
+{
+	static constexpr uint16_t recordTypeA = 1;
+	static constexpr uint16_t recordTypeCname = 5;
+	static constexpr uint16_t recordTypeAaaa = 28;
+	static constexpr uint16_t recordTypeOpt = 41;
+
+	static constexpr uint8_t responseCodeNoError = 0;
+	static constexpr uint8_t responseCodeNameError = 3; // NXDOMAIN
+
+	static constexpr uint16_t maxUdpPayloadSize = 1232; // advertised with EDNS(0)
+
+	struct DnsResponse
+	{
+		uint8_t responseCode {0};
+		bool isTruncated {false};
+		std::vector<asio::ip::address> addresses;
+		uint32_t ttl {std::numeric_limits<uint32_t>::max()};
+	};
+
+	static inline uint16_t readUint16(const uint8_t *data)
+	{
+		return static_cast<uint16_t>(data[0] << 8 | data[1]);
+	}
+
+	static inline uint32_t readUint32(const uint8_t *data)
+	{
+		return static_cast<uint32_t>(data[0]) << 24 | static_cast<uint32_t>(data[1]) << 16 | static_cast<uint32_t>(data[2]) << 8 | data[3];
+	}
+
+	static inline void writeUint16(std::vector<uint8_t> &data, uint16_t value)
+	{
+		data.push_back(static_cast<uint8_t>(value >> 8));
+		data.push_back(static_cast<uint8_t>(value & 0xFF));
+	}
+
+	static uint16_t generateQueryId()
+	{
+		static std::mt19937 generator {std::random_device {}()};
+		return static_cast<uint16_t>(generator());
+	}
+
+	static std::string toLower(std::string_view str)
+	{
+		std::string result(str);
+		std::transform(result.begin(), result.end(), result.begin(), [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+		return result;
+	}
+
+	// returns an empty vector for invalid host names
+	static std::vector<uint8_t> buildQuery(std::string_view hostName, uint16_t type)
+	{
+		std::vector<uint8_t> query;
+
+		if (!hostName.empty() && hostName.back() == '.')
+		{
+			hostName.remove_suffix(1);
+		}
+
+		if (hostName.empty() || hostName.size() > 253)
+		{
+			return query;
+		}
+
+		query.reserve(12 + hostName.size() + 2 + 4 + 11);
+
+		writeUint16(query, 0); // id, set before sending
+		writeUint16(query, 0x0100); // recursion desired
+		writeUint16(query, 1); // questions
+		writeUint16(query, 0); // answers
+		writeUint16(query, 0); // authority records
+		writeUint16(query, 1); // additional records (OPT)
+
+		for (size_t start = 0; start <= hostName.size();)
+		{
+			size_t end = std::min(hostName.find('.', start), hostName.size());
+			size_t length = end - start;
+
+			if (length == 0 || length > 63)
+			{
+				return {};
+			}
+
+			query.push_back(static_cast<uint8_t>(length));
+			query.insert(query.end(), hostName.begin() + start, hostName.begin() + end);
+			start = end + 1;
+		}
+
+		query.push_back(0);
+		writeUint16(query, type);
+		writeUint16(query, 1); // class IN
+
+		query.push_back(0); // root name
+		writeUint16(query, recordTypeOpt);
+		writeUint16(query, maxUdpPayloadSize);
+		query.insert(query.end(), {0, 0, 0, 0}); // extended response code, version, flags
+		writeUint16(query, 0); // no options
+
+		return query;
+	}
+
+	static bool skipName(const uint8_t *data, size_t size, size_t &offset)
+	{
+		while (offset < size)
+		{
+			uint8_t length = data[offset];
+
+			if (length == 0)
+			{
+				offset += 1;
+				return true;
+			}
+
+			if ((length & 0xC0) == 0xC0) // compression pointer ends the name
+			{
+				offset += 2;
+				return offset <= size;
+			}
+
+			if ((length & 0xC0) != 0)
+			{
+				return false;
+			}
+
+			offset += 1 + length;
+		}
+
+		return false;
+	}
+
+	static bool parseResponse(const uint8_t *data, size_t size, uint16_t id, uint16_t type, DnsResponse &response)
+	{
+		if (size < 12 || readUint16(data) != id || (data[2] & 0x80) == 0) // not a response to our query
+		{
+			return false;
+		}
+
+		response.isTruncated = (data[2] & 0x02) != 0;
+		response.responseCode = data[3] & 0x0F;
+
+		const uint16_t questionCount = readUint16(data + 4);
+		const uint16_t answerCount = readUint16(data + 6);
+		size_t offset = 12;
+
+		for (uint16_t i = 0; i < questionCount; i++)
+		{
+			if (!skipName(data, size, offset) || offset + 4 > size)
+			{
+				return false;
+			}
+
+			offset += 4;
+		}
+
+		for (uint16_t i = 0; i < answerCount; i++)
+		{
+			if (!skipName(data, size, offset) || offset + 10 > size)
+			{
+				return response.isTruncated;
+			}
+
+			const uint16_t recordType = readUint16(data + offset);
+			const uint32_t ttl = readUint32(data + offset + 4);
+			const uint16_t dataLength = readUint16(data + offset + 8);
+			offset += 10;
+
+			if (offset + dataLength > size)
+			{
+				return response.isTruncated;
+			}
+
+			if (recordType == type && type == recordTypeA && dataLength == 4)
+			{
+				asio::ip::address_v4::bytes_type bytes;
+				std::memcpy(bytes.data(), data + offset, bytes.size());
+				response.addresses.push_back(asio::ip::address_v4(bytes));
+			}
+			else if (recordType == type && type == recordTypeAaaa && dataLength == 16)
+			{
+				asio::ip::address_v6::bytes_type bytes;
+				std::memcpy(bytes.data(), data + offset, bytes.size());
+				response.addresses.push_back(asio::ip::address_v6(bytes));
+			}
+
+			if (recordType == type || recordType == recordTypeCname)
+			{
+				response.ttl = std::min(response.ttl, ttl);
+			}
+
+			offset += dataLength;
+		}
+
+		return true;
+	}
+
+	static bool parsePort(std::string_view str, unsigned short &port)
+	{
+		std::from_chars_result result = std::from_chars(str.data(), str.data() + str.size(), port);
+		return result.ec == std::errc() && result.ptr == str.data() + str.size();
+	}
+
+	static bool parseNameServer(std::string_view str, asio::ip::udp::endpoint &endpoint)
+	{
+		std::string_view address = str;
+		unsigned short port = 53;
+
+		if (str.size() > 0 && str[0] == '[') // [address]:port
+		{
+			size_t end = str.find(']');
+
+			if (end == std::string::npos)
+			{
+				return false;
+			}
+
+			address = str.substr(1, end - 1);
+
+			if (end + 1 < str.size() && (str[end + 1] != ':' || !parsePort(str.substr(end + 2), port)))
+			{
+				return false;
+			}
+		}
+		else if (size_t colon = str.find(':'); colon != std::string::npos && str.find(':', colon + 1) == std::string::npos) // ipv4:port
+		{
+			address = str.substr(0, colon);
+
+			if (!parsePort(str.substr(colon + 1), port))
+			{
+				return false;
+			}
+		}
+
+		asio::error_code ec;
+		asio::ip::address ipAddress = asio::ip::make_address(std::string(address), ec);
+
+		if (ec)
+		{
+			return false;
+		}
+
+		endpoint = asio::ip::udp::endpoint(ipAddress, port);
+
+		return true;
+	}
+
+	// Queries a single record type, trying every name server for the given number of attempts
+	class DnsQuery : public std::enable_shared_from_this<DnsQuery>
+	{
+	public:
+		using Callback = std::function<void(const asio::error_code &ec, const DnsResponse &response)>;
+
+		DnsQuery(asio::io_context &ioContext, const std::vector<asio::ip::udp::endpoint> &nameServers, std::chrono::milliseconds timeout, int attempts, std::vector<uint8_t> query, uint16_t type, Callback callback) :
+			_nameServers {nameServers},
+			_timeout {timeout},
+			_tryCount {nameServers.size() * static_cast<size_t>(std::max(attempts, 1))},
+			_query {std::move(query)},
+			_type {type},
+			_callback {std::move(callback)},
+			_udpSocket {ioContext},
+			_tcpSocket {ioContext},
+			_timer {ioContext}
+		{
+		}
+
+		void start()
+		{
+			sendNext();
+		}
+
+	private:
+		void sendNext()
+		{
+			asio::error_code ec;
+			_udpSocket.close(ec);
+			_tcpSocket.close(ec);
+
+			if (_tryIndex >= _tryCount)
+			{
+				finish(_lastError, {});
+				return;
+			}
+
+			_server = _nameServers[_tryIndex++ % _nameServers.size()];
+			_id = generateQueryId();
+			_query[0] = static_cast<uint8_t>(_id >> 8);
+			_query[1] = static_cast<uint8_t>(_id & 0xFF);
+
+			_udpSocket.open(_server.protocol(), ec);
+
+			if (ec)
+			{
+				_lastError = ec;
+				sendNext();
+				return;
+			}
+
+			statistics.dnsQueries.fetch_add(1, std::memory_order_relaxed);
+
+			_udpSocket.async_send_to(asio::buffer(_query), _server,
+				[self = shared_from_this(), tryIndex = _tryIndex](const asio::error_code &ec, size_t)
+				{
+					if (ec && !self->_isFinished && tryIndex == self->_tryIndex)
+					{
+						self->_lastError = ec;
+						self->sendNext();
+					}
+				}
+			);
+
+			receive();
+
+			_timer.expires_after(_timeout);
+			_timer.async_wait(
+				[self = shared_from_this(), tryIndex = _tryIndex](const asio::error_code &ec)
+				{
+					if (!ec && !self->_isFinished && tryIndex == self->_tryIndex)
+					{
+						self->_lastError = asio::error::timed_out;
+						self->sendNext();
+					}
+				}
+			);
+		}
+
+		void receive()
+		{
+			_response.resize(maxUdpPayloadSize);
+
+			_udpSocket.async_receive_from(asio::buffer(_response), _sender,
+				[self = shared_from_this(), tryIndex = _tryIndex](const asio::error_code &ec, size_t size)
+				{
+					if (self->_isFinished || tryIndex != self->_tryIndex)
+					{
+						return;
+					}
+
+					if (ec)
+					{
+						self->_lastError = ec;
+						self->sendNext();
+						return;
+					}
+
+					DnsResponse response;
+
+					if (self->_sender != self->_server || !parseResponse(self->_response.data(), size, self->_id, self->_type, response))
+					{
+						self->receive(); // not ours, keep waiting
+					}
+					else if (response.isTruncated)
+					{
+						self->queryOverTcp();
+					}
+					else
+					{
+						self->handleResponse(response);
+					}
+				}
+			);
+		}
+
+		void queryOverTcp()
+		{
+			statistics.dnsTcpQueries.fetch_add(1, std::memory_order_relaxed);
+
+			_tcpQuery.clear();
+			writeUint16(_tcpQuery, static_cast<uint16_t>(_query.size()));
+			_tcpQuery.insert(_tcpQuery.end(), _query.begin(), _query.end());
+
+			_tcpSocket.async_connect(asio::ip::tcp::endpoint(_server.address(), _server.port()),
+				[self = shared_from_this(), tryIndex = _tryIndex](const asio::error_code &ec)
+				{
+					if (self->_isFinished || tryIndex != self->_tryIndex)
+					{
+						return;
+					}
+
+					if (ec)
+					{
+						self->_lastError = ec;
+						self->sendNext();
+						return;
+					}
+
+					asio::async_write(self->_tcpSocket, asio::buffer(self->_tcpQuery),
+						[self, tryIndex](const asio::error_code &ec, size_t)
+						{
+							if (self->_isFinished || tryIndex != self->_tryIndex)
+							{
+								return;
+							}
+
+							if (ec)
+							{
+								self->_lastError = ec;
+								self->sendNext();
+								return;
+							}
+
+							self->receiveOverTcp();
+						}
+					);
+				}
+			);
+		}
+
+		void receiveOverTcp()
+		{
+			_response.resize(2);
+
+			asio::async_read(_tcpSocket, asio::buffer(_response),
+				[self = shared_from_this(), tryIndex = _tryIndex](const asio::error_code &ec, size_t)
+				{
+					if (self->_isFinished || tryIndex != self->_tryIndex)
+					{
+						return;
+					}
+
+					if (ec)
+					{
+						self->_lastError = ec;
+						self->sendNext();
+						return;
+					}
+
+					self->_response.resize(readUint16(self->_response.data()));
+
+					asio::async_read(self->_tcpSocket, asio::buffer(self->_response),
+						[self, tryIndex](const asio::error_code &ec, size_t size)
+						{
+							if (self->_isFinished || tryIndex != self->_tryIndex)
+							{
+								return;
+							}
+
+							DnsResponse response;
+
+							if (ec || !parseResponse(self->_response.data(), size, self->_id, self->_type, response))
+							{
+								self->_lastError = ec ? ec : asio::error::no_recovery;
+								self->sendNext();
+								return;
+							}
+
+							self->handleResponse(response);
+						}
+					);
+				}
+			);
+		}
+
+		void handleResponse(const DnsResponse &response)
+		{
+			switch (response.responseCode)
+			{
+				case responseCodeNoError:
+					finish(response.addresses.empty() ? asio::error::no_data : asio::error_code(), response);
+					break;
+				case responseCodeNameError:
+					finish(asio::error::host_not_found, response);
+					break;
+				default: // SERVFAIL, REFUSED, etc: ask the next server
+					_lastError = asio::error::no_recovery;
+					sendNext();
+					break;
+			}
+		}
+
+		void finish(const asio::error_code &ec, const DnsResponse &response)
+		{
+			_isFinished = true;
+
+			asio::error_code ignored;
+			_timer.cancel();
+			_udpSocket.close(ignored);
+			_tcpSocket.close(ignored);
+
+			_callback(ec, response);
+		}
+
+		const std::vector<asio::ip::udp::endpoint> _nameServers;
+		const std::chrono::milliseconds _timeout;
+		const size_t _tryCount;
+		std::vector<uint8_t> _query;
+		std::vector<uint8_t> _tcpQuery;
+		std::vector<uint8_t> _response;
+		const uint16_t _type;
+		Callback _callback;
+
+		asio::ip::udp::socket _udpSocket;
+		asio::ip::tcp::socket _tcpSocket;
+		asio::steady_timer _timer;
+		asio::ip::udp::endpoint _server;
+		asio::ip::udp::endpoint _sender;
+		asio::error_code _lastError {asio::error::timed_out};
+		size_t _tryIndex {0};
+		uint16_t _id {0};
+		bool _isFinished {false};
+	};
+
+	// Collects the A and AAAA answers of one lookup
+	struct DnsLookup
+	{
+		DnsResolver::ResolveCallback callback;
+		std::string hostName;
+		std::string service;
+		std::vector<asio::ip::tcp::endpoint> endpoints;
+		asio::error_code error;
+		uint32_t ttl {std::numeric_limits<uint32_t>::max()};
+		int pendingQueries {2};
+
+		void addResult(const asio::error_code &ec, const DnsResponse &response, unsigned short port)
+		{
+			if (!ec)
+			{
+				for (const asio::ip::address &address : response.addresses)
+				{
+					endpoints.emplace_back(address, port);
+				}
+			}
+
+			if (!ec || ec == asio::error::no_data || ec == asio::error::host_not_found)
+			{
+				ttl = std::min(ttl, response.ttl);
+			}
+
+			if (ec && (!error || ec == asio::error::host_not_found))
+			{
+				error = ec;
+			}
+
+			if (--pendingQueries > 0)
+			{
+				return;
+			}
+
+			auto results = asio::ip::tcp::resolver::results_type::create(endpoints.begin(), endpoints.end(), hostName, service);
+			std::chrono::seconds resultTtl(ttl == std::numeric_limits<uint32_t>::max() ? 0 : ttl);
+
+			callback(endpoints.empty() ? error : asio::error_code(), results, resultTtl);
+		}
+	};
+}
+
+DnsResolver::DnsResolver(asio::io_context &ioContext) : _ioContext {ioContext}
+{
+}
+
+bool DnsResolver::configure(const std::vector<std::string> &nameServers)
+{
+	_nameServers.clear();
+	_hosts.clear();
+
+	if (nameServers.empty())
+	{
+		loadResolvConf("/etc/resolv.conf");
+	}
+	else
+	{
+		for (const std::string &nameServer : nameServers)
+		{
+			if (asio::ip::udp::endpoint endpoint; parseNameServer(nameServer, endpoint))
+			{
+				_nameServers.push_back(endpoint);
+			}
+			else
+			{
+				fprintf(stderr, "Invalid name server address: \"%s\"\n", nameServer.c_str());
+			}
+		}
+	}
+
+	loadHosts("/etc/hosts");
+
+	return !_nameServers.empty();
+}
+
+void DnsResolver::resolveAsync(std::string_view hostName, size_t port, const ResolveCallback &callback)
+{
+	const std::string service = std::to_string(port);
+	const unsigned short portNumber = static_cast<unsigned short>(port);
+	std::vector<asio::ip::tcp::endpoint> endpoints;
+	std::chrono::seconds ttl {0};
+
+	asio::error_code ec;
+	asio::ip::address address = asio::ip::make_address(std::string(hostName), ec);
+
+	if (!ec) // IP literal
+	{
+		endpoints.emplace_back(address, portNumber);
+	}
+	else
+	{
+		auto range = _hosts.equal_range(toLower(hostName));
+
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			endpoints.emplace_back(it->second, portNumber);
+			ttl = hostsFileTtl;
+		}
+	}
+
+	if (!endpoints.empty())
+	{
+		auto results = asio::ip::tcp::resolver::results_type::create(endpoints.begin(), endpoints.end(), std::string(hostName), service);
+		asio::post(_ioContext, [callback, results, ttl]() { callback(asio::error_code(), results, ttl); });
+		return;
+	}
+
+	std::vector<uint8_t> queryA = buildQuery(hostName, recordTypeA);
+	std::vector<uint8_t> queryAaaa = buildQuery(hostName, recordTypeAaaa);
+
+	if (queryA.empty() || queryAaaa.empty() || _nameServers.empty())
+	{
+		asio::post(_ioContext, [callback]() { callback(asio::error::host_not_found, {}, std::chrono::seconds(0)); });
+		return;
+	}
+
+	auto lookup = std::make_shared<DnsLookup>();
+	lookup->callback = callback;
+	lookup->hostName = hostName;
+	lookup->service = service;
+
+	auto onResult = [lookup, portNumber](const asio::error_code &ec, const DnsResponse &response)
+	{
+		lookup->addResult(ec, response, portNumber);
+	};
+
+	std::make_shared<DnsQuery>(_ioContext, _nameServers, _timeout, _attempts, std::move(queryAaaa), recordTypeAaaa, onResult)->start();
+	std::make_shared<DnsQuery>(_ioContext, _nameServers, _timeout, _attempts, std::move(queryA), recordTypeA, onResult)->start();
+}
+
+void DnsResolver::loadResolvConf(std::string_view path)
+{
+	std::ifstream ifs(path.data());
+
+	for (std::string line; std::getline(ifs, line);)
+	{
+		std::istringstream iss(line);
+		std::string keyword;
+		iss >> keyword;
+
+		if (keyword == "nameserver")
+		{
+			std::string address;
+			iss >> address;
+
+			if (asio::ip::udp::endpoint endpoint; parseNameServer(address, endpoint))
+			{
+				_nameServers.push_back(endpoint);
+			}
+		}
+		else if (keyword == "options")
+		{
+			for (std::string option; iss >> option;)
+			{
+				if (stringStartsWith(option, "timeout:"))
+				{
+					_timeout = std::chrono::seconds(std::max(std::atoi(option.c_str() + 8), 1));
+				}
+				else if (stringStartsWith(option, "attempts:"))
+				{
+					_attempts = std::max(std::atoi(option.c_str() + 9), 1);
+				}
+			}
+		}
+	}
+}
+
+void DnsResolver::loadHosts(std::string_view path)
+{
+	std::ifstream ifs(path.data());
+
+	for (std::string line; std::getline(ifs, line);)
+	{
+		if (size_t commentPos = line.find('#'); commentPos != std::string::npos)
+		{
+			line.resize(commentPos);
+		}
+
+		std::istringstream iss(line);
+		std::string addressString;
+
+		if (!(iss >> addressString))
+		{
+			continue;
+		}
+
+		asio::error_code ec;
+		asio::ip::address address = asio::ip::make_address(addressString, ec);
+
+		if (ec)
+		{
+			continue;
+		}
+
+		for (std::string name; iss >> name;)
+		{
+			_hosts.emplace(toLower(name), address);
+		}
+	}
+}
\ No newline at end of file
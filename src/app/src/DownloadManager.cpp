@@ -0,0 +1,299 @@
+#include "DownloadManager.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <asio/post.hpp>
+
+#include <nfd.h>
+
+using namespace gem;
+
+namespace
+{
+	static inline bool isActive(DownloadState state)
+	{
+		return state == DownloadState::ChoosingPath || state == DownloadState::Receiving;
+	}
+}
+
+std::vector<std::shared_ptr<Download>> DownloadManager::_downloads;
+std::optional<asio::thread_pool> DownloadManager::_dialogThread;
+std::optional<asio::thread_pool> DownloadManager::_fileThread;
+
+void DownloadManager::start(const std::shared_ptr<GeminiClient> &client, std::string url, std::string fileName)
+{
+	auto download = std::make_shared<Download>();
+	download->url = std::move(url);
+	download->fileName = std::move(fileName);
+	download->client = client;
+	download->sampleTime = std::chrono::steady_clock::now();
+
+	_downloads.push_back(download);
+
+	if (!_fileThread)
+	{
+		// both threads exist before any task, the dialog thread posts to the file thread
+		_fileThread.emplace(1);
+#if !defined(__APPLE__)
+		_dialogThread.emplace(1);
+#endif
+	}
+
+#if defined(__APPLE__)
+	choosePath(download); // AppKit panels must run on the main thread
+#else
+	asio::post(*_dialogThread, [download]() { choosePath(download); });
+#endif
+
+	client->receiveResponseBodyStreamAsync(std::bind(&receiveChunk, client, download, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void DownloadManager::cancel(const std::shared_ptr<Download> &download)
+{
+	DownloadState state = download->state.load();
+
+	while (isActive(state))
+	{
+		if (download->state.compare_exchange_weak(state, DownloadState::Cancelled))
+		{
+			if (std::shared_ptr<GeminiClient> client = download->client.lock())
+			{
+				client->cancel();
+			}
+
+			asio::post(*_fileThread, [download]() { closeFile(download, DownloadState::Cancelled); });
+			break;
+		}
+	}
+}
+
+void DownloadManager::removeFinished()
+{
+	_downloads.erase(std::remove_if(_downloads.begin(), _downloads.end(),
+		[](const std::shared_ptr<Download> &download)
+		{
+			return !isActive(download->state.load());
+		}
+	), _downloads.end());
+}
+
+void DownloadManager::update()
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	for (const std::shared_ptr<Download> &download : _downloads)
+	{
+		if (!isActive(download->state.load()))
+		{
+			download->bytesPerSecond = 0;
+			continue;
+		}
+
+		if (auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - download->sampleTime); elapsed.count() >= 1000)
+		{
+			download->bytesPerSecond = (download->bytesReceived - download->sampleBytes) * 1000 / elapsed.count();
+			download->sampleBytes = download->bytesReceived;
+			download->sampleTime = now;
+		}
+	}
+}
+
+void DownloadManager::shutdown()
+{
+	for (const std::shared_ptr<Download> &download : _downloads)
+	{
+		cancel(download);
+	}
+
+	if (!_fileThread)
+	{
+		return; // nothing was downloaded
+	}
+
+	_fileThread->join();
+
+	if (_dialogThread)
+	{
+		_dialogThread->stop(); // an open dialog still has to be closed by the user
+		_dialogThread->join();
+	}
+
+	// the dialog thread may post to the file thread until it is joined
+	_dialogThread.reset();
+	_fileThread.reset();
+}
+
+const std::vector<std::shared_ptr<Download>> &DownloadManager::getDownloads()
+{
+	return _downloads;
+}
+
+void DownloadManager::receiveChunk(std::shared_ptr<GeminiClient> client, std::shared_ptr<Download> download, GeminiClient::ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk)
+{
+	if (clientCode != GeminiClient::ClientCode::SUCCESS)
+	{
+		asio::post(*_fileThread, [download]() { closeFile(download, DownloadState::Failed); });
+		return;
+	}
+
+	if (!isActive(download->state.load()))
+	{
+		client->cancel(); // the save dialog was dismissed or writing failed
+		return;
+	}
+
+	download->bytesReceived += chunk->size();
+
+	asio::post(*_fileThread,
+		[download, chunk, isLastChunk]()
+		{
+			writeChunk(download, chunk);
+
+			if (isLastChunk)
+			{
+				download->isReceived = true;
+
+				if (download->state.load() == DownloadState::Receiving)
+				{
+					closeFile(download, DownloadState::Completed);
+				}
+			}
+		}
+	);
+}
+
+void DownloadManager::choosePath(const std::shared_ptr<Download> &download)
+{
+	std::string path;
+
+	// NFD must be initialized on the thread showing the dialog
+	if (NFD_Init() == NFD_OKAY)
+	{
+		char *savePath;
+
+		if (NFD_SaveDialogU8(&savePath, nullptr, 0, nullptr, download->fileName.c_str()) == NFD_OKAY)
+		{
+			path = savePath;
+			NFD_FreePathU8(savePath);
+		}
+
+		NFD_Quit();
+	}
+	else
+	{
+		fprintf(stderr, "NFD Error: %s\n", NFD_GetError());
+	}
+
+	asio::post(*_fileThread, [download, path = std::move(path)]() { openFile(download, path); });
+}
+
+void DownloadManager::openFile(const std::shared_ptr<Download> &download, std::string path)
+{
+	if (path.empty())
+	{
+		closeFile(download, DownloadState::Cancelled);
+		return;
+	}
+
+	if (download->state.load() != DownloadState::ChoosingPath)
+	{
+		return; // cancelled while the dialog was open
+	}
+
+	download->path = std::move(path);
+	download->file = std::make_unique<FileWriter>(_fileThread->get_executor());
+
+	if (!download->file->open(download->path))
+	{
+		fprintf(stderr, "Failed to save file to the directory \"%s\"\n", download->path.c_str());
+		download->file.reset();
+		closeFile(download, DownloadState::Failed);
+		return;
+	}
+
+	DownloadState state = DownloadState::ChoosingPath;
+
+	if (!download->state.compare_exchange_strong(state, DownloadState::Receiving))
+	{
+		return; // cancelled meanwhile, the cleanup is queued
+	}
+
+	std::vector<std::shared_ptr<Buffer>> pendingChunks = std::move(download->pendingChunks);
+	download->pendingChunks.clear();
+
+	for (const std::shared_ptr<Buffer> &chunk : pendingChunks)
+	{
+		writeChunk(download, chunk);
+	}
+
+	if (download->isReceived && download->state.load() == DownloadState::Receiving)
+	{
+		closeFile(download, DownloadState::Completed);
+	}
+}
+
+void DownloadManager::writeChunk(const std::shared_ptr<Download> &download, const std::shared_ptr<Buffer> &chunk)
+{
+	switch (download->state.load())
+	{
+		case DownloadState::ChoosingPath:
+			download->pendingChunks.push_back(chunk); // keeps the stream paused once the buffer limit is reached
+			break;
+		case DownloadState::Receiving:
+			download->file->write(chunk);
+
+			// an asynchronous write reports its failure with one of the next chunks
+			if (download->file->hasFailed())
+			{
+				closeFile(download, DownloadState::Failed);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void DownloadManager::closeFile(const std::shared_ptr<Download> &download, DownloadState state)
+{
+	if (download->file == nullptr)
+	{
+		finishFile(download, state);
+		return;
+	}
+
+	if (download->isClosing)
+	{
+		return; // the first close decides, a cancellation is still applied in finishFile
+	}
+
+	download->isClosing = true;
+	download->file->close(
+		[download, state](bool isWritten) mutable
+		{
+			if (!isWritten)
+			{
+				fprintf(stderr, "Failed to write file \"%s\"\n", download->path.c_str());
+				state = DownloadState::Failed;
+			}
+
+			download->file.reset();
+			finishFile(download, state);
+		}
+	);
+}
+
+void DownloadManager::finishFile(const std::shared_ptr<Download> &download, DownloadState state)
+{
+	download->pendingChunks.clear();
+
+	// a cancellation is never overridden
+	for (DownloadState current = download->state.load(); isActive(current) && !download->state.compare_exchange_weak(current, state);)
+	{
+	}
+
+	if (download->state.load() != DownloadState::Completed && !download->path.empty())
+	{
+		std::remove(download->path.c_str()); // do not leave partial files behind
+	}
+}
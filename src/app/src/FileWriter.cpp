@@ -0,0 +1,142 @@
+#include "FileWriter.hpp"
+
+#include <asio/buffer.hpp>
+#include <asio/post.hpp>
+
+#if defined(GEM_IO_URING)
+	#include <asio/write.hpp>
+#endif
+
+using namespace gem;
+
+#if defined(GEM_IO_URING)
+
+FileWriter::FileWriter(const asio::any_io_executor &executor) : _file {executor}
+{
+}
+
+FileWriter::~FileWriter()
+{
+	asio::error_code ec;
+	_file.close(ec);
+}
+
+bool FileWriter::open(const std::string &path)
+{
+	asio::error_code ec;
+	_file.open(path, asio::file_base::write_only | asio::file_base::create | asio::file_base::truncate, ec);
+
+	return !ec;
+}
+
+void FileWriter::write(std::shared_ptr<Buffer> chunk)
+{
+	if (!_file.is_open() || _hasFailed || _closeCallback)
+	{
+		return;
+	}
+
+	_queuedChunks.push_back(std::move(chunk));
+
+	if (_writingChunks.empty())
+	{
+		writeQueuedAsync();
+	}
+}
+
+void FileWriter::close(CloseCallback callback)
+{
+	_closeCallback = std::move(callback);
+
+	if (_writingChunks.empty())
+	{
+		writeQueuedAsync(); // nothing in flight, finishes right away
+	}
+}
+
+void FileWriter::writeQueuedAsync()
+{
+	_writingChunks.swap(_queuedChunks);
+	_queuedChunks.clear();
+
+	if (_writingChunks.empty() || _hasFailed)
+	{
+		_writingChunks.clear();
+
+		if (_closeCallback)
+		{
+			asio::error_code ec;
+			_file.close(ec);
+
+			// the owner may destroy the writer in the callback
+			asio::post(_file.get_executor(), [callback = std::move(_closeCallback), isWritten = !_hasFailed && !ec]() { callback(isWritten); });
+			_closeCallback = nullptr;
+		}
+
+		return;
+	}
+
+	std::vector<asio::const_buffer> buffers;
+	buffers.reserve(_writingChunks.size());
+
+	for (const std::shared_ptr<Buffer> &chunk : _writingChunks)
+	{
+		buffers.push_back(asio::buffer(*chunk));
+	}
+
+	// the writer outlives its writes, the owner waits for the close callback
+	asio::async_write(_file, buffers,
+		[this](const asio::error_code &ec, std::size_t)
+		{
+			_hasFailed = _hasFailed || ec;
+			_writingChunks.clear();
+
+			if (!_queuedChunks.empty() || _closeCallback)
+			{
+				writeQueuedAsync();
+			}
+		}
+	);
+}
+
+#else
+
+FileWriter::FileWriter(const asio::any_io_executor &executor) : _executor {executor}
+{
+}
+
+FileWriter::~FileWriter()
+{
+	if (_file != nullptr)
+	{
+		fclose(_file);
+	}
+}
+
+bool FileWriter::open(const std::string &path)
+{
+	_file = fopen(path.c_str(), "wb");
+
+	return _file != nullptr;
+}
+
+void FileWriter::write(std::shared_ptr<Buffer> chunk)
+{
+	if (_file != nullptr && !_hasFailed)
+	{
+		_hasFailed = fwrite(chunk->data(), 1, chunk->size(), _file) != chunk->size();
+	}
+}
+
+void FileWriter::close(CloseCallback callback)
+{
+	if (_file != nullptr)
+	{
+		_hasFailed = fclose(_file) != 0 || _hasFailed;
+		_file = nullptr;
+	}
+
+	asio::post(_executor, [callback = std::move(callback), isWritten = !_hasFailed]() { callback(isWritten); });
+}
+
+#endif
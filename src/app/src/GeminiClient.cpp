@@ -1,10 +1,27 @@
 #include "GeminiClient.hpp"
+#include "BufferPool.hpp"
+#include "ConnectionRacer.hpp"
+#include "Deadline.hpp"
+#include "KnownHosts.hpp"
+#include "Statistics.hpp"
 #include "Utilities.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <charconv>
+#include <utility>
+#include <unordered_set>
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 #include <asio/buffer.hpp>
 #include <asio/connect.hpp>
+#include <asio/post.hpp>
 #include <asio/read.hpp>
 #include <asio/read_until.hpp>
 #include <asio/streambuf.hpp>
@@ -14,6 +31,10 @@ using namespace gem;
 
 namespace
 {
+	static Settings clientSettings; // written before the network thread starts
+	static std::unordered_set<std::string> fastOpenFailedHosts; // accessed from the network thread only
+	static KnownHosts knownHosts; // accessed from the network thread only
+
 	static inline bool checkErrorCode(const asio::error_code &ec, std::string_view failMessage = "", bool eofIsError = true)
 	{
 		if (!ec || (!eofIsError && ec == asio::error::eof))
@@ -27,12 +48,32 @@ namespace
 		return false;
 	}
 
-	static void parseHeader(std::string_view header, const GeminiClient::ResponseHeaderCallback &callback)
+	static inline GeminiClient::ClientCode getClientCode(const Deadline &deadline, GeminiClient::ClientCode clientCode)
+	{
+		if (clientCode == GeminiClient::ClientCode::SUCCESS || !deadline.isExpired())
+		{
+			return clientCode;
+		}
+
+		return deadline.getReason() == Deadline::Reason::Cancelled ? GeminiClient::ClientCode::CANCELLED : GeminiClient::ClientCode::TIMEOUT;
+	}
+
+	static inline void closeSocket(asio::ssl::stream<asio::ip::tcp::socket> *socket)
+	{
+		asio::error_code ignored;
+		socket->lowest_layer().close(ignored); // pending operations complete with an error
+	}
+
+	static bool parseHeader(std::string_view header, StatusCode &statusCode, std::string &meta)
 	{
+		if (header.size() >= 2 && header.substr(header.size() - 2) == "\r\n")
+		{
+			header.remove_suffix(2); // meta may be a redirect target
+		}
+
 		if (!header.empty())
 		{
 			int code;
-			std::string meta;
 			std::from_chars_result result;
 
 			if (size_t spacePos = header.find(' '); spacePos != std::string::npos)
@@ -67,109 +108,339 @@ namespace
 					case 60:
 					case 61:
 					case 62:
-						callback(GeminiClient::ClientCode::SUCCESS, static_cast<StatusCode>(code), meta);
-						return;
+						statusCode = static_cast<StatusCode>(code);
+						return true;
 					default:
 						break;
 				}
 			}
 		}
 
-		fprintf(stderr, "Malformed header: \"%s\"\n", header.data());
+		fprintf(stderr, "Malformed header: \"%.*s\"\n", static_cast<int>(header.size()), header.data());
+		meta.clear();
 
-		callback(GeminiClient::ClientCode::RESPONSE_HEADER_ERROR, StatusCode::NONE, "");
+		return false;
 	}
 
-	static void sendRequestAsync(asio::ssl::stream<asio::ip::tcp::socket> *socket, const std::string &url, const GeminiClient::ConnectionCallback &callback)
+	// The kernel keeps the Fast Open cookie per server and falls back to a regular handshake
+	// when the server does not support it; hosts where a Fast Open connection failed are skipped.
+	// A Fast Open connect completes before any packet is exchanged, so it is only used on a path known to work.
+	static void openSocket(asio::ip::tcp::socket &socket, const asio::ip::tcp::endpoint &endpoint, std::string_view hostName, bool isKnownPath)
 	{
-		std::string request = url + "\r\n";
+		asio::error_code ec;
+		socket.close(ec);
+		socket.open(endpoint.protocol(), ec);
+
+#if defined(__linux__)
+		if (!ec && isKnownPath && clientSettings.tcpFastOpen && fastOpenFailedHosts.find(std::string(hostName)) == fastOpenFailedHosts.end())
+		{
+			int enable = 1;
 
-		asio::async_write(*socket, asio::buffer(request),
-			[callback](const std::error_code &ec, std::size_t)
+			if (setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enable, sizeof(enable)) == 0)
+			{
+				statistics.tcpFastOpenAttempts.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+#else
+		(void)hostName;
+		(void)isKnownPath;
+#endif
+	}
+
+	static bool isFastOpenEnabled([[maybe_unused]] asio::ip::tcp::socket &socket)
+	{
+#if defined(__linux__)
+		int enabled = 0;
+		socklen_t size = sizeof(enabled);
+
+		return socket.is_open() && getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enabled, &size) == 0 && enabled != 0;
+#else
+		return false;
+#endif
+	}
+
+	static void recordFastOpenResult([[maybe_unused]] asio::ip::tcp::socket &socket)
+	{
+#if defined(__linux__)
+		tcp_info info {};
+		socklen_t size = sizeof(info);
+
+		if (isFastOpenEnabled(socket) && getsockopt(socket.native_handle(), IPPROTO_TCP, TCP_INFO, &info, &size) == 0 && (info.tcpi_options & TCPI_OPT_SYN_DATA))
+		{
+			statistics.tcpFastOpenAccepted.fetch_add(1, std::memory_order_relaxed);
+		}
+#endif
+	}
+
+	// One connection attempt. Every step of the chain shares it, so handlers capture a single pointer
+	// instead of copying the URL and the callback, and the deadline interrupts fit in std::function without allocating.
+	struct Connection
+	{
+		asio::ssl::stream<asio::ip::tcp::socket> *socket;
+		std::string hostName; // of the server, the capsule or a proxy
+		size_t port;
+		std::string url;
+		bool sendsRequest;
+		bool earlyDataWritten {false};
+		std::string earlyData; // ClientHello and request, kept until written
+		std::shared_ptr<Deadline> deadline;
+		GeminiClient::ConnectionCallback callback;
+	};
+
+	static void sendRequestAsync(const std::shared_ptr<Connection> &connection)
+	{
+		const std::array<asio::const_buffer, 2> request {asio::buffer(connection->url), asio::buffer("\r\n", 2)};
+
+		asio::async_write(*connection->socket, request, bindPoolAllocator(
+			[connection](const std::error_code &ec, std::size_t)
 			{
 				if (checkErrorCode(ec, "Request failed"))
 				{
-					callback(GeminiClient::ClientCode::SUCCESS);
+					connection->callback(GeminiClient::ClientCode::SUCCESS);
 				}
 				else
 				{
-					callback(GeminiClient::ClientCode::REQUEST_ERROR);
+					connection->callback(GeminiClient::ClientCode::REQUEST_ERROR);
 				}
 			}
-		);
+		));
+	}
+
+	// Writes the ClientHello followed by the request as TLS 1.3 early data into a memory BIO.
+	// asio's engine only flushes output produced during its own operations, so the caller sends the result manually.
+	static void writeEarlyData(Connection &connection)
+	{
+		SSL *ssl = connection.socket->native_handle();
+		SSL_SESSION *session = SSL_get_session(ssl);
+		connection.earlyDataWritten = false;
+
+		if (session == nullptr || SSL_SESSION_get_max_early_data(session) < connection.url.size() + 2)
+		{
+			return;
+		}
+
+		const std::string request = connection.url + "\r\n";
+
+		BIO *engineBio = SSL_get_wbio(ssl);
+		BIO *memoryBio = BIO_new(BIO_s_mem());
+		BIO_up_ref(engineBio);
+		SSL_set0_wbio(ssl, memoryBio);
+
+		size_t written = 0;
+		connection.earlyDataWritten = SSL_write_early_data(ssl, request.data(), request.size(), &written) == 1 && written == request.size();
+
+		if (!connection.earlyDataWritten)
+		{
+			ERR_clear_error();
+		}
+
+		char *data = nullptr;
+		long size = BIO_get_mem_data(memoryBio, &data);
+		connection.earlyData.assign(data, size > 0 ? size : 0);
+
+		SSL_set0_wbio(ssl, engineBio); // frees memoryBio
 	}
 
-	static void handshakeAsync(asio::ssl::stream<asio::ip::tcp::socket> *socket, const std::string &url, const GeminiClient::ConnectionCallback &callback)
+	static void finishHandshakeAsync(const std::shared_ptr<Connection> &connection)
 	{
-		socket->async_handshake(asio::ssl::stream_base::client,
-			[socket, url, callback](const std::error_code &ec)
+		connection->socket->async_handshake(asio::ssl::stream_base::client, bindPoolAllocator(
+			[connection](const std::error_code &ec)
 			{
-				if (checkErrorCode(ec, "TLS handshake failed"))
+				asio::ssl::stream<asio::ip::tcp::socket> *socket = connection->socket;
+				connection->deadline->finishPhase();
+
+				if (!connection->deadline->isExpired() && checkErrorCode(ec, "TLS handshake failed"))
 				{
-					sendRequestAsync(socket, url, callback);
+					SSL *ssl = socket->native_handle();
+					recordFastOpenResult(socket->next_layer());
+
+					asio::error_code endpointError;
+					const size_t port = socket->next_layer().remote_endpoint(endpointError).port();
+
+					if (knownHosts.verify(ssl, connection->hostName, port) == KnownHosts::Result::Mismatch)
+					{
+						connection->callback(GeminiClient::ClientCode::CERTIFICATE_MISMATCH);
+						return;
+					}
+
+					if (SSL_session_reused(ssl))
+					{
+						statistics.tlsResumedHandshakes.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						statistics.tlsFullHandshakes.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					if (!connection->sendsRequest)
+					{
+						connection->callback(GeminiClient::ClientCode::SUCCESS);
+						return;
+					}
+
+					// the request and the response header share one deadline
+					connection->deadline->startPhase(std::chrono::milliseconds(clientSettings.timeouts.firstByte), [socket]() { closeSocket(socket); });
+
+					if (connection->earlyDataWritten && SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED)
+					{
+						statistics.tlsEarlyDataAccepted.fetch_add(1, std::memory_order_relaxed);
+						connection->callback(GeminiClient::ClientCode::SUCCESS); // the request has already been sent
+						return;
+					}
+
+					if (connection->earlyDataWritten)
+					{
+						statistics.tlsEarlyDataRejected.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					sendRequestAsync(connection);
 				}
 				else
 				{
-					callback(GeminiClient::ClientCode::TLS_HANDSHAKE_ERROR);
+					connection->callback(GeminiClient::ClientCode::TLS_HANDSHAKE_ERROR);
 				}
 			}
-		);
+		));
 	}
 
-	static void connectAsync(asio::ssl::stream<asio::ip::tcp::socket> *socket, const std::string &url, const asio::ip::tcp::resolver::results_type &endpoints, const GeminiClient::ConnectionCallback &callback)
+	static void handshakeAsync(const std::shared_ptr<Connection> &connection)
 	{
-		asio::async_connect(socket->next_layer(), endpoints,
-			[socket, url, callback](const std::error_code &ec, const asio::ip::tcp::endpoint &)
+		connection->deadline->startPhase(std::chrono::milliseconds(clientSettings.timeouts.handshake), [socket = connection->socket]() { closeSocket(socket); });
+
+		if (clientSettings.tlsEarlyData && connection->sendsRequest)
+		{
+			writeEarlyData(*connection);
+		}
+
+		if (connection->earlyData.empty())
+		{
+			connection->earlyDataWritten = false;
+			finishHandshakeAsync(connection);
+			return;
+		}
+
+		asio::async_write(connection->socket->next_layer(), asio::buffer(connection->earlyData), bindPoolAllocator(
+			[connection](const std::error_code &ec, std::size_t)
+			{
+				connection->earlyData.clear();
+
+				if (!connection->deadline->isExpired() && checkErrorCode(ec, "Sending TLS early data failed"))
+				{
+					finishHandshakeAsync(connection);
+				}
+				else
+				{
+					connection->deadline->finishPhase();
+					connection->callback(GeminiClient::ClientCode::TLS_HANDSHAKE_ERROR);
+				}
+			}
+		));
+	}
+
+	static void connectAsync(const std::shared_ptr<Connection> &connection, const asio::ip::tcp::resolver::results_type &endpoints)
+	{
+		// the racer and its opener never outlive the handler owning the connection
+		auto opener = [connection = connection.get()](asio::ip::tcp::socket &tcpSocket, const asio::ip::tcp::endpoint &endpoint, bool isKnownPath)
+		{
+			openSocket(tcpSocket, endpoint, connection->hostName, isKnownPath);
+		};
+
+		auto racer = std::make_shared<ConnectionRacer>(connection->socket->get_executor(), connection->hostName, endpoints, opener);
+		connection->deadline->startPhase(std::chrono::milliseconds(clientSettings.timeouts.connect), [racer = racer.get()]() { racer->cancel(); });
+
+		racer->start(
+			[connection](const std::error_code &ec, asio::ip::tcp::socket tcpSocket)
 			{
-				if (checkErrorCode(ec, "Connection failed"))
+				connection->deadline->finishPhase();
+
+				if (!connection->deadline->isExpired() && checkErrorCode(ec, "Connection failed"))
 				{
-					handshakeAsync(socket, url, callback);
+					connection->socket->next_layer() = std::move(tcpSocket);
+					handshakeAsync(connection);
 				}
 				else
 				{
-					callback(GeminiClient::ClientCode::CONNECTION_ERROR);
+					connection->callback(GeminiClient::ClientCode::CONNECTION_ERROR);
 				}
 			}
 		);
 	}
 
-	static void resolveAsync(asio::io_context &ioContext, asio::ssl::stream<asio::ip::tcp::socket> *socket, const std::string &url, size_t port, const GeminiClient::ConnectionCallback &callback)
+	// Resolves, connects to the server (the capsule or a proxy) and completes the TLS handshake, then sends the request unless sendsRequest is false
+	static void resolveAsync(ResolverCache &resolverCache, const std::shared_ptr<Connection> &connection)
 	{
-		auto resolver = std::make_shared<asio::ip::tcp::resolver>(ioContext);
-		std::string_view hostName = extractHostName(url);
+		// the lookup may be shared with other requests, so it is abandoned rather than stopped
+		connection->deadline->startPhase(std::chrono::milliseconds(clientSettings.timeouts.resolve),
+			[connection = connection.get()]() { connection->callback(GeminiClient::ClientCode::HOST_NAME_RESOLUTION_ERROR); });
 
-		resolver->async_resolve(hostName, std::to_string(port),
-			[socket, url, resolver, callback](const std::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints)
+		resolverCache.resolveAsync(connection->hostName, connection->port,
+			[connection](const std::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints)
 			{
-				if (checkErrorCode(ec, "Host name resolution failed"))
+				if (connection->deadline->isExpired())
 				{
-					connectAsync(socket, url, endpoints, callback);
+					return; // already reported by the interrupt
+				}
+
+				connection->deadline->finishPhase();
+
+				if (checkErrorCode(ec, "Host name resolution failed") && !endpoints.empty())
+				{
+					connectAsync(connection, endpoints);
 				}
 				else
 				{
-					callback(GeminiClient::ClientCode::HOST_NAME_RESOLUTION_ERROR);
+					connection->callback(GeminiClient::ClientCode::HOST_NAME_RESOLUTION_ERROR);
 				}
 			}
 		);
 	}
 
-	static bool verifyCertificate([[maybe_unused]] bool preverified, asio::ssl::verify_context &context)
+	// A proxy takes absolute URLs of other hosts, the request line stays the same
+	static bool isProxied(std::string_view hostName)
 	{
-		char name[256];
-		X509 *cert = X509_STORE_CTX_get_current_cert(context.native_handle());
-		X509_NAME_oneline(X509_get_subject_name(cert), name, 256);
-		printf("Verifying %s\n", name);
+		const std::vector<std::string> &hostPatterns = clientSettings.proxy.hostPatterns;
+
+		if (clientSettings.proxy.host.empty())
+		{
+			return false;
+		}
+
+		return hostPatterns.empty() || std::any_of(hostPatterns.begin(), hostPatterns.end(),
+			[hostName](std::string_view pattern)
+			{
+				if (pattern.size() > 2 && pattern.substr(0, 2) == "*.") // any subdomain
+				{
+					pattern.remove_prefix(1);
+					return hostName.size() > pattern.size() && hostName.substr(hostName.size() - pattern.size()) == pattern;
+				}
+
+				return pattern == "*" || pattern == hostName;
+			}
+		);
+	}
+
+	static std::pair<std::string, size_t> getServer(std::string_view hostName, size_t port)
+	{
+		if (isProxied(hostName))
+		{
+			return {clientSettings.proxy.host, clientSettings.proxy.port};
+		}
 
-		return true;
+		return {std::string(hostName), port};
 	}
 
-	static inline asio::ssl::context createSslContext()
+	static void configureSslContext(asio::ssl::context &context, TlsSessionCache &sessionCache)
 	{
-		asio::ssl::context context(asio::ssl::context::tlsv12_client);
-		context.set_options(asio::ssl::context::default_workarounds);
+		context.set_options(asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2 | asio::ssl::context::no_sslv3 | asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1);
 		context.set_default_verify_paths();
-		context.set_verify_mode(asio::ssl::context::verify_none);
-		context.set_verify_callback(verifyCertificate);
+		context.set_verify_mode(asio::ssl::context::verify_none); // self-signed certificates are the norm, KnownHosts checks them after the handshake
+		sessionCache.attach(context.native_handle());
+	}
+
+	static inline asio::ssl::context createSslContext(TlsSessionCache &sessionCache)
+	{
+		asio::ssl::context context(asio::ssl::context::tls_client); // TLS 1.2 or 1.3
+		configureSslContext(context, sessionCache);
 		context.use_certificate_file("assets/certificates/gem.crt", asio::ssl::context_base::file_format::pem);
 		context.use_private_key_file("assets/certificates/gem.key", asio::ssl::context_base::file_format::pem);
 
@@ -178,59 +449,458 @@ namespace
 }
 
 asio::io_context GeminiClient::_ioContext;
-asio::ssl::context GeminiClient::_sslContext = createSslContext();
+ResolverCache GeminiClient::_resolverCache(_ioContext);
+TlsSessionCache GeminiClient::_sessionCache;
+asio::ssl::context GeminiClient::_sslContext = createSslContext(_sessionCache);
+std::optional<asio::executor_work_guard<asio::io_context::executor_type>> GeminiClient::_workGuard;
+std::thread GeminiClient::_networkThread;
+LockFreeQueue<std::function<void()>> GeminiClient::_completionQueue;
+std::unordered_map<std::string, std::shared_ptr<GeminiClient::Preconnection>> GeminiClient::_preconnections;
 
-void GeminiClient::connectAsync(const ConnectionCallback &callback, std::string url, size_t port /*= 1965*/)
+GeminiClient::GeminiClient() : _deadline {std::make_shared<Deadline>(_ioContext.get_executor())}
 {
-	delete _socket;
-	_socket = new asio::ssl::stream<asio::ip::tcp::socket>(_ioContext, _sslContext);
+}
 
-	resolveAsync(_ioContext, _socket, url, port, callback);
+GeminiClient::~GeminiClient()
+{
+	// pending operations own the client, only the deadline timer may still refer to the socket
+	asio::post(_ioContext,
+		[socket = _socket, deadline = _deadline, identity = _identity]()
+		{
+			deadline->finishPhase();
+			delete socket;
+		}
+	);
 }
 
-void GeminiClient::receiveResponseHeaderAsync(const ResponseHeaderCallback &callback)
+void GeminiClient::connectAsync(ConnectionCallback callback, std::string url, size_t port /*= 1965*/, std::shared_ptr<ClientIdentity> identity /*= nullptr*/)
 {
-	auto buffer = new std::string();
+	_identity = std::move(identity);
+	statistics.clientRequests.fetch_add(1, std::memory_order_relaxed);
+
+	// callbacks are invoked once, so they are moved along rather than copied
+	ConnectionCallback dispatchingCallback = [this, callback = std::move(callback)](ClientCode clientCode) mutable
+	{
+		clientCode = getClientCode(*_deadline, clientCode);
+		dispatch([callback = std::move(callback), clientCode]() { callback(clientCode); });
+	};
 
-	asio::async_read_until(*_socket, asio::dynamic_buffer(*buffer), "\r\n",
-		[buffer, callback](const std::error_code &ec, std::size_t size)
+	// all socket operations are started and completed on the network thread
+	asio::post(_ioContext,
+		[this, url = std::move(url), port, dispatchingCallback = std::move(dispatchingCallback)]() mutable
 		{
-			if (checkErrorCode(ec, "Receiving response header failed"))
+			startConnection(std::move(url), port, std::move(dispatchingCallback), true);
+		}
+	);
+}
+
+struct GeminiClient::BodyStream : public std::enable_shared_from_this<BodyStream>
+{
+	static constexpr size_t chunkSize = 16 * 1024; // maximum TLS record payload
+
+	BodyStream(asio::ssl::stream<asio::ip::tcp::socket> *socket, const std::shared_ptr<Deadline> &deadline, ResponseChunkCallback callback, size_t maxBufferedSize) :
+		socket {socket},
+		deadline {deadline},
+		callback {std::move(callback)},
+		maxBufferedSize {maxBufferedSize}
+	{
+	}
+
+	void readNextChunk()
+	{
+		auto chunk = BufferPool::acquireBuffer(chunkSize);
+		chunk->resize(chunkSize);
+
+		// a paused stream has no deadline, the consumer is slow, not the server
+		deadline->startPhase(std::chrono::milliseconds(clientSettings.timeouts.idle), [socket = socket]() { closeSocket(socket); });
+
+		socket->async_read_some(asio::buffer(*chunk), bindPoolAllocator(
+			[self = shared_from_this(), chunk](const asio::error_code &ec, std::size_t size)
 			{
-				parseHeader(std::string_view(buffer->data(), size), callback);
+				chunk->resize(size);
+				self->deadline->finishPhase();
+
+				if (self->deadline->isExpired())
+				{
+					self->deliver(getClientCode(*self->deadline, ClientCode::RESPONSE_BODY_ERROR), nullptr, true);
+				}
+				else if (!ec)
+				{
+					self->deliver(ClientCode::SUCCESS, chunk, false);
+
+					if (self->bufferedSize.load(std::memory_order_acquire) >= self->maxBufferedSize)
+					{
+						self->isPaused = true; // the consumer resumes reading
+					}
+					else
+					{
+						self->readNextChunk();
+					}
+				}
+				else if (checkErrorCode(ec, "Receiving response body failed", false))
+				{
+					self->deliver(ClientCode::SUCCESS, chunk, true);
+				}
+				else
+				{
+					self->deliver(ClientCode::RESPONSE_BODY_ERROR, nullptr, true);
+				}
 			}
-			else
+		));
+	}
+
+	void deliver(ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk)
+	{
+		if (chunk)
+		{
+			// the consumer may keep the chunk as long as it needs, releasing it makes room for the next ones
+			const size_t size = chunk->size();
+			bufferedSize.fetch_add(size, std::memory_order_acq_rel);
+
+			Buffer *data = chunk.get();
+			chunk = std::shared_ptr<Buffer>(data, [self = shared_from_this(), owner = std::move(chunk), size](Buffer *) { self->release(size); }, PoolAllocator<char>());
+		}
+
+		dispatch([self = shared_from_this(), clientCode, chunk = std::move(chunk), isLastChunk]() { self->callback(clientCode, chunk, isLastChunk); });
+	}
+
+	void release(size_t size) // any thread
+	{
+		const size_t previousSize = bufferedSize.fetch_sub(size, std::memory_order_acq_rel);
+
+		// only the release crossing the limit resumes, reading is paused at most once per crossing
+		if (previousSize >= maxBufferedSize && previousSize - size < maxBufferedSize)
+		{
+			asio::post(_ioContext, [self = shared_from_this()]() { self->resume(); });
+		}
+	}
+
+	void resume()
+	{
+		if (isPaused)
+		{
+			isPaused = false;
+			readNextChunk();
+		}
+	}
+
+	asio::ssl::stream<asio::ip::tcp::socket> *socket;
+	std::shared_ptr<Deadline> deadline;
+	ResponseChunkCallback callback;
+	size_t maxBufferedSize;
+	std::atomic<size_t> bufferedSize {0}; // delivered chunks still held by the consumer
+	bool isPaused {false}; // network thread only
+};
+
+void GeminiClient::receiveResponseHeaderAsync(ResponseHeaderCallback callback)
+{
+	// the callback owns the client, so capturing this is safe
+	asio::post(_ioContext,
+		[this, callback = std::move(callback)]() mutable
+		{
+			_readBuffer = BufferPool::acquireBuffer(BodyStream::chunkSize);
+
+			asio::async_read_until(*_socket, asio::dynamic_buffer(*_readBuffer), "\r\n", bindPoolAllocator(
+				[this, callback = std::move(callback)](const std::error_code &ec, std::size_t size) mutable
+				{
+					ClientCode clientCode = ClientCode::RESPONSE_HEADER_ERROR;
+					StatusCode statusCode = StatusCode::NONE;
+					std::string meta;
+
+					_deadline->finishPhase();
+
+					if (!_deadline->isExpired() && checkErrorCode(ec, "Receiving response header failed"))
+					{
+						if (parseHeader(std::string_view(_readBuffer->data(), size), statusCode, meta))
+						{
+							clientCode = ClientCode::SUCCESS;
+						}
+
+						_readBuffer->erase(_readBuffer->begin(), _readBuffer->begin() + size); // the rest belongs to the body
+					}
+
+					clientCode = getClientCode(*_deadline, clientCode);
+					dispatch([callback = std::move(callback), clientCode, statusCode, meta = std::move(meta)]() { callback(clientCode, statusCode, meta); });
+				}
+			));
+		}
+	);
+}
+
+void GeminiClient::receiveResponseBodyStreamAsync(ResponseChunkCallback callback, size_t maxBufferedSize /*= defaultMaxBufferedSize*/)
+{
+	asio::post(_ioContext,
+		[this, callback = std::move(callback), maxBufferedSize]() mutable
+		{
+			auto stream = std::make_shared<BodyStream>(_socket, _deadline, std::move(callback), maxBufferedSize);
+
+			// the header buffer is handed over as the first chunk instead of being copied
+			if (_readBuffer && !_readBuffer->empty())
 			{
-				callback(ClientCode::RESPONSE_HEADER_ERROR, StatusCode::NONE, "");
+				stream->deliver(ClientCode::SUCCESS, std::move(_readBuffer), false);
 			}
 
-			delete buffer;
+			_readBuffer.reset();
+
+			stream->readNextChunk();
 		}
 	);
 }
 
-void GeminiClient::receiveResponseBodyAsync(const ResponseBodyCallback &callback)
+struct GeminiClient::Preconnection
+{
+	Preconnection() :
+		socket {new asio::ssl::stream<asio::ip::tcp::socket>(_ioContext, _sslContext)},
+		deadline {std::make_shared<Deadline>(_ioContext.get_executor())},
+		expiryTimer {_ioContext}
+	{
+	}
+
+	~Preconnection()
+	{
+		// may be destroyed inside a completion handler of the socket
+		asio::post(_ioContext,
+			[socket = socket, deadline = deadline]()
+			{
+				deadline->finishPhase();
+				delete socket;
+			}
+		);
+	}
+
+	asio::ssl::stream<asio::ip::tcp::socket> *socket; // nullptr once adopted by a client
+	std::shared_ptr<Deadline> deadline;
+	asio::steady_timer expiryTimer;
+	bool isReady {false};
+};
+
+void GeminiClient::startConnection(std::string url, size_t port, ConnectionCallback callback, bool canRetry)
 {
-	auto buffer = std::make_shared<std::vector<char>>();
+	// a client certificate is meant for the capsule, so such requests never go through the proxy
+	auto [hostName, serverPort] = _identity ? std::pair(std::string(extractHostName(url)), port) : getServer(extractHostName(url), port);
+
+	auto connection = std::make_shared<Connection>();
+	connection->url = std::move(url);
+	connection->sendsRequest = true;
+	connection->deadline = _deadline;
+
+	// preconnections are anonymous
+	if (auto it = _identity || _preconnections.empty() ? _preconnections.end() : _preconnections.find(hostName + ':' + std::to_string(serverPort));
+		it != _preconnections.end() && it->second->isReady)
+	{
+		// the handshake is done, the request goes out right away
+		statistics.preconnectsUsed.fetch_add(1, std::memory_order_relaxed);
+
+		delete _socket;
+		_socket = std::exchange(it->second->socket, nullptr);
+		it->second->expiryTimer.cancel();
+		_preconnections.erase(it);
 
-	// capture socket to prolong its life
-	asio::async_read(*_socket, asio::dynamic_buffer(*buffer),
-		[buffer, callback](const std::error_code &ec, std::size_t)
+		connection->socket = _socket;
+		connection->callback = std::move(callback);
+
+		_deadline->startPhase(std::chrono::milliseconds(clientSettings.timeouts.firstByte), [socket = _socket]() { closeSocket(socket); });
+		sendRequestAsync(connection);
+		return;
+	}
+
+	delete _socket;
+	_socket = new asio::ssl::stream<asio::ip::tcp::socket>(_ioContext, _identity ? _identity->context : _sslContext);
+	(_identity ? _identity->sessionCache : _sessionCache).prepare(_socket->native_handle(), hostName, serverPort);
+
+	connection->socket = _socket;
+	connection->hostName = std::move(hostName);
+	connection->port = serverPort;
+
+	// the callback owns the client and belongs to the connection, so capturing both is safe
+	connection->callback = [this, connection = connection.get(), port, canRetry, callback = std::move(callback)](ClientCode clientCode) mutable
+	{
+		if (canRetry && clientCode != ClientCode::SUCCESS && clientCode != ClientCode::HOST_NAME_RESOLUTION_ERROR && clientCode != ClientCode::CERTIFICATE_MISMATCH && !_deadline->isExpired() && isFastOpenEnabled(_socket->next_layer()))
+		{
+			// retry once with a regular TCP handshake, some middleboxes drop SYN packets carrying data
+			fastOpenFailedHosts.emplace(connection->hostName);
+			startConnection(std::move(connection->url), port, std::move(callback), false);
+			return;
+		}
+
+		callback(clientCode);
+	};
+
+	resolveAsync(_resolverCache, connection);
+}
+
+void GeminiClient::cancel()
+{
+	asio::post(_ioContext, [deadline = _deadline]() { deadline->cancel(); });
+}
+
+void GeminiClient::prefetchHosts(std::vector<std::string> hostNames, size_t port /*= 1965*/)
+{
+	asio::post(_ioContext,
+		[hostNames = std::move(hostNames), port]()
 		{
-			if (checkErrorCode(ec, "Receiving response body failed", false))
+			for (const std::string &hostName : hostNames)
 			{
-				callback(GeminiClient::ClientCode::SUCCESS, buffer);
+				if (!isProxied(hostName)) // only the proxy resolves them
+				{
+					_resolverCache.prefetch(hostName, port);
+				}
 			}
-			else
+		}
+	);
+}
+
+void GeminiClient::preconnect(std::string hostName, size_t port /*= 1965*/)
+{
+	asio::post(_ioContext,
+		[hostName = std::move(hostName), port]()
+		{
+			const auto [serverHostName, serverPort] = getServer(hostName, port);
+			const std::string key = serverHostName + ':' + std::to_string(serverPort);
+
+			if (_preconnections.find(key) != _preconnections.end() || _preconnections.size() >= maxPreconnections)
 			{
-				callback(GeminiClient::ClientCode::RESPONSE_BODY_ERROR, nullptr);
+				return;
 			}
+
+			statistics.preconnectsStarted.fetch_add(1, std::memory_order_relaxed);
+
+			auto preconnection = std::make_shared<Preconnection>();
+			_sessionCache.prepare(preconnection->socket->native_handle(), serverHostName, serverPort);
+			_preconnections.emplace(key, preconnection);
+
+			auto connection = std::make_shared<Connection>();
+			connection->socket = preconnection->socket;
+			connection->hostName = serverHostName;
+			connection->port = serverPort;
+			connection->sendsRequest = false;
+			connection->deadline = preconnection->deadline;
+			connection->callback = [key, preconnection](ClientCode clientCode)
+			{
+				preconnection->deadline->finishPhase();
+
+				auto it = _preconnections.find(key);
+
+				if (it == _preconnections.end() || it->second != preconnection)
+				{
+					return; // cancelled
+				}
+
+				if (clientCode != ClientCode::SUCCESS || preconnection->deadline->isExpired())
+				{
+					_preconnections.erase(it);
+					return;
+				}
+
+				preconnection->isReady = true;
+				preconnection->expiryTimer.expires_after(preconnectGracePeriod);
+				preconnection->expiryTimer.async_wait(
+					[key, preconnectionWeakPtr = std::weak_ptr<Preconnection>(preconnection)](const asio::error_code &ec)
+					{
+						auto it = _preconnections.find(key);
+
+						if (!ec && it != _preconnections.end() && it->second == preconnectionWeakPtr.lock())
+						{
+							_preconnections.erase(it); // not used in time
+						}
+					}
+				);
+			};
+
+			resolveAsync(_resolverCache, connection);
 		}
 	);
 }
 
-void GeminiClient::poll()
+void GeminiClient::cancelPreconnect(std::string hostName, size_t port /*= 1965*/)
+{
+	asio::post(_ioContext,
+		[hostName = std::move(hostName), port]()
+		{
+			// established connections are kept for the grace period
+			const auto [serverHostName, serverPort] = getServer(hostName, port);
+
+			if (auto it = _preconnections.find(serverHostName + ':' + std::to_string(serverPort)); it != _preconnections.end() && !it->second->isReady)
+			{
+				it->second->deadline->cancel();
+				_preconnections.erase(it);
+			}
+		}
+	);
+}
+
+std::shared_ptr<ClientIdentity> GeminiClient::createIdentity(const std::string &certificatePath, const std::string &keyPath)
+{
+	auto identity = std::make_shared<ClientIdentity>();
+	configureSslContext(identity->context, identity->sessionCache);
+
+	asio::error_code ec;
+	identity->context.use_certificate_file(certificatePath, asio::ssl::context_base::file_format::pem, ec);
+
+	if (!ec)
+	{
+		identity->context.use_private_key_file(keyPath, asio::ssl::context_base::file_format::pem, ec);
+	}
+
+	if (!checkErrorCode(ec, "Loading client certificate failed"))
+	{
+		return nullptr;
+	}
+
+	return identity;
+}
+
+void GeminiClient::startNetworkThread(const Settings &settings, std::string knownHostsPath)
 {
+	assert(!_networkThread.joinable());
+
+	clientSettings = settings;
+
+	if (clientSettings.builtinResolver)
+	{
+		_resolverCache.useDnsResolver(clientSettings.dnsServers);
+	}
+	_workGuard.emplace(_ioContext.get_executor());
+	_networkThread = std::thread(
+		[knownHostsPath = std::move(knownHostsPath)]()
+		{
+			countsAllocations = true;
+			knownHosts.open(knownHostsPath);
+			_ioContext.run();
+		}
+	);
+}
+
+void GeminiClient::stopNetworkThread()
+{
+	if (!_networkThread.joinable())
+	{
+		return;
+	}
+
+	_workGuard.reset();
+	_ioContext.stop();
+	_networkThread.join();
+
+	// handlers posted before the stop still delete sockets, run them before the state they touch goes
+	_ioContext.restart();
 	_ioContext.poll();
+	poll();
+
+	_preconnections.clear();
+	knownHosts.close();
 	_ioContext.restart();
+}
+
+void GeminiClient::poll()
+{
+	for (std::function<void()> handler; _completionQueue.pop(handler);)
+	{
+		handler();
+	}
+}
+
+void GeminiClient::dispatch(std::function<void()> handler)
+{
+	_completionQueue.push(std::move(handler));
 }
\ No newline at end of file
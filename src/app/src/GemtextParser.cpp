@@ -1,25 +1,29 @@
 #include "GemtextParser.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 namespace
 {
-	static inline bool isBlank(const std::vector<char> &data, size_t index)
+	static inline bool isBlank(const gem::Body &data, size_t index)
 	{
 		return std::isblank(static_cast<unsigned char>(data[index]));
 	}
 }
 
-void gem::GemtextParser::parse(std::vector<GemtextLine> &lines, const std::vector<char> &data)
+void gem::GemtextParser::parse(std::vector<GemtextLine> &lines, std::deque<std::string> &joinedText, const Body &data)
 {
 	const size_t size = data.size();
-	std::string_view view(data.data(), size);
+
+	// lines are viewed in place, only those split between two body segments are joined
+	auto view = [&data, &joinedText, size](size_t offset, size_t count) { return data.view(offset, std::min(count, size - offset), joinedText); };
 
 	GemtextLineType lineType = GemtextLineType::Text;
 	bool newLineStarted = true, blockModeOn = false, foundSpaceBetweenLinkAndText = false;
 	int64_t lineTextStart = -1, lineLinkEnd = -1, lineLinkStart = -1;
 
 	lines.clear();
+	joinedText.clear();
 
 	for (size_t i = 0; i < size; i++)
 	{
@@ -39,7 +43,7 @@ void gem::GemtextParser::parse(std::vector<GemtextLine> &lines, const std::vecto
 						}
 						else
 						{
-							lines.push_back({lineType, view.substr(lineTextStart, lineEnd - lineTextStart)});
+							lines.push_back({lineType, view(lineTextStart, lineEnd - lineTextStart)});
 						}
 
 						break;
@@ -51,11 +55,11 @@ void gem::GemtextParser::parse(std::vector<GemtextLine> &lines, const std::vecto
 						assert(lineLinkStart >= 0);
 						if (lineLinkEnd > lineLinkStart) // link with text
 						{
-							line = {lineType, view.substr(lineTextStart, lineEnd - lineTextStart), view.substr(lineLinkStart, lineLinkEnd - lineLinkStart)};
+							line = {lineType, view(lineTextStart, lineEnd - lineTextStart), view(lineLinkStart, lineLinkEnd - lineLinkStart)};
 						}
 						else // just link
 						{
-							line = {lineType, "", view.substr(lineLinkStart, lineEnd - lineLinkStart)};
+							line = {lineType, "", view(lineLinkStart, lineEnd - lineLinkStart)};
 						}
 
 						line.linkHasSchema = line.link.find("//") != std::string::npos;
@@ -72,7 +76,7 @@ void gem::GemtextParser::parse(std::vector<GemtextLine> &lines, const std::vecto
 					default:
 						if (lineTextStart >= 0)
 						{
-							lines.push_back({lineType, view.substr(lineTextStart, lineEnd - lineTextStart)});
+							lines.push_back({lineType, view(lineTextStart, lineEnd - lineTextStart)});
 						}
 
 						break;
@@ -107,7 +111,7 @@ void gem::GemtextParser::parse(std::vector<GemtextLine> &lines, const std::vecto
 				{
 					blockModeOn = false;
 					i = size; // skip to the end
-					lines.push_back({lineType, view.substr(lineTextStart, i - lineTextStart)});
+					lines.push_back({lineType, view(lineTextStart, i - lineTextStart)});
 					lineTextStart = -1;
 				}
 
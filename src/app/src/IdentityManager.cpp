@@ -0,0 +1,358 @@
+#include "IdentityManager.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include <asio/post.hpp>
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/x509.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/prettywriter.h>
+
+using namespace gem;
+
+namespace
+{
+	static constexpr long certificateValidity = 20L * 365 * 24 * 60 * 60; // seconds, capsules pin the certificate rather than check dates
+
+	static EVP_PKEY *generateKey()
+	{
+		EVP_PKEY *key = nullptr;
+		EVP_PKEY_CTX *keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+
+		if (keyContext == nullptr || EVP_PKEY_keygen_init(keyContext) != 1 ||
+			EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) != 1 ||
+			EVP_PKEY_keygen(keyContext, &key) != 1)
+		{
+			key = nullptr;
+		}
+
+		EVP_PKEY_CTX_free(keyContext);
+
+		return key;
+	}
+
+	static X509 *createCertificate(EVP_PKEY *key, const std::string &commonName)
+	{
+		X509 *certificate = X509_new();
+		uint32_t serial = 0;
+
+		if (certificate == nullptr || RAND_bytes(reinterpret_cast<unsigned char *>(&serial), sizeof(serial)) != 1)
+		{
+			X509_free(certificate);
+			return nullptr;
+		}
+
+		X509_NAME *name = X509_get_subject_name(certificate);
+
+		bool isSigned = X509_set_version(certificate, 2) == 1 && // v3
+			ASN1_INTEGER_set(X509_get_serialNumber(certificate), static_cast<long>(serial >> 1)) == 1 &&
+			X509_gmtime_adj(X509_getm_notBefore(certificate), 0) != nullptr &&
+			X509_gmtime_adj(X509_getm_notAfter(certificate), certificateValidity) != nullptr &&
+			X509_set_pubkey(certificate, key) == 1 &&
+			X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_UTF8, reinterpret_cast<const unsigned char *>(commonName.c_str()), -1, -1, 0) == 1 &&
+			X509_set_issuer_name(certificate, name) == 1 &&
+			X509_sign(certificate, key, EVP_sha256()) > 0;
+
+		if (!isSigned)
+		{
+			X509_free(certificate);
+			return nullptr;
+		}
+
+		return certificate;
+	}
+}
+
+std::string IdentityManager::_directory;
+std::vector<IdentityManager::Identity> IdentityManager::_identities;
+std::vector<std::pair<std::string, size_t>> IdentityManager::_prefixes;
+std::vector<std::string> IdentityManager::_pendingPrefixes;
+uint32_t IdentityManager::_lastId = 0;
+std::optional<asio::thread_pool> IdentityManager::_keyThread;
+LockFreeQueue<IdentityManager::Completion> IdentityManager::_completions;
+
+void IdentityManager::load(std::string directory)
+{
+	_directory = std::move(directory);
+
+	const std::string path = (std::filesystem::path(_directory) / "Identities.json").string();
+
+	if (!std::filesystem::exists(path))
+	{
+		return;
+	}
+
+	std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+	std::size_t size = ifs.tellg();
+	std::string buffer(size, '\0');
+	ifs.seekg(0, std::ios::beg);
+	ifs.read(buffer.data(), size);
+
+	rapidjson::Document doc;
+	doc.Parse(buffer.data(), size);
+
+	// the file may have been edited by hand, malformed entries are skipped
+	if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("identities") || !doc["identities"].IsArray())
+	{
+		return;
+	}
+
+	if (doc.HasMember("lastId") && doc["lastId"].IsUint())
+	{
+		_lastId = doc["lastId"].GetUint();
+	}
+
+	for (const auto &identityObject : doc["identities"].GetArray())
+	{
+		if (!identityObject.IsObject() ||
+			!identityObject.HasMember("id") || !identityObject["id"].IsUint() ||
+			!identityObject.HasMember("name") || !identityObject["name"].IsString() ||
+			!identityObject.HasMember("prefixes") || !identityObject["prefixes"].IsArray())
+		{
+			continue;
+		}
+
+		Identity identity {identityObject["id"].GetUint(), identityObject["name"].GetString(), {}, nullptr};
+
+		for (const auto &prefix : identityObject["prefixes"].GetArray())
+		{
+			if (prefix.IsString())
+			{
+				identity.urlPrefixes.emplace_back(prefix.GetString());
+			}
+		}
+
+		// the files may have been deleted by hand
+		if (std::filesystem::exists(getCertificatePath(identity.id)) && std::filesystem::exists(getKeyPath(identity.id)))
+		{
+			_lastId = std::max(_lastId, identity.id);
+			add(std::move(identity));
+		}
+	}
+}
+
+void IdentityManager::save()
+{
+	if (_directory.empty())
+	{
+		return;
+	}
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+
+	writer.Key("lastId");
+	writer.Uint(_lastId);
+
+	writer.Key("identities");
+	writer.StartArray();
+
+	for (const Identity &identity : _identities)
+	{
+		writer.StartObject();
+		writer.Key("id");
+		writer.Uint(identity.id);
+		writer.Key("name");
+		writer.String(identity.name);
+		writer.Key("prefixes");
+		writer.StartArray();
+
+		for (const std::string &prefix : identity.urlPrefixes)
+		{
+			writer.String(prefix);
+		}
+
+		writer.EndArray();
+		writer.EndObject();
+	}
+
+	writer.EndArray();
+
+	writer.EndObject();
+
+	std::error_code ec;
+	std::filesystem::create_directories(_directory, ec);
+
+	std::ofstream ofs((std::filesystem::path(_directory) / "Identities.json").string(), std::ios::binary);
+	ofs.write(buffer.GetString(), buffer.GetSize());
+}
+
+void IdentityManager::shutdown()
+{
+	if (_keyThread)
+	{
+		_keyThread->join();
+		_keyThread.reset();
+	}
+
+	// keys generated meanwhile are kept, nobody waits for the callbacks anymore
+	for (Completion completion; _completions.pop(completion);)
+	{
+		if (completion.context)
+		{
+			add(std::move(completion.identity));
+		}
+	}
+
+	_pendingPrefixes.clear();
+}
+
+void IdentityManager::createAsync(std::string name, std::string urlPrefix, CreateCallback callback)
+{
+	_pendingPrefixes.push_back(urlPrefix);
+
+	Identity identity {++_lastId, std::move(name), {std::move(urlPrefix)}, nullptr};
+
+	if (!_keyThread)
+	{
+		_keyThread.emplace(1);
+	}
+
+	asio::post(*_keyThread,
+		[identity = std::move(identity), callback = std::move(callback)]() mutable
+		{
+			std::shared_ptr<ClientIdentity> context;
+
+			if (generate(identity))
+			{
+				context = GeminiClient::createIdentity(getCertificatePath(identity.id), getKeyPath(identity.id));
+			}
+
+			_completions.push({std::move(identity), std::move(context), std::move(callback)});
+		}
+	);
+}
+
+bool IdentityManager::isCreating(std::string_view urlPrefix)
+{
+	return std::find(_pendingPrefixes.begin(), _pendingPrefixes.end(), urlPrefix) != _pendingPrefixes.end();
+}
+
+std::shared_ptr<ClientIdentity> IdentityManager::find(std::string_view url)
+{
+	for (const auto &[prefix, index] : _prefixes)
+	{
+		if (url.substr(0, prefix.size()) != prefix)
+		{
+			continue;
+		}
+
+		Identity &identity = _identities[index];
+
+		if (!identity.context)
+		{
+			identity.context = GeminiClient::createIdentity(getCertificatePath(identity.id), getKeyPath(identity.id));
+		}
+
+		return identity.context;
+	}
+
+	return nullptr;
+}
+
+void IdentityManager::poll()
+{
+	for (Completion completion; _completions.pop(completion);)
+	{
+		const std::string &prefix = completion.identity.urlPrefixes.front();
+
+		if (auto it = std::find(_pendingPrefixes.begin(), _pendingPrefixes.end(), prefix); it != _pendingPrefixes.end())
+		{
+			_pendingPrefixes.erase(it);
+		}
+
+		const bool isCreated = completion.context != nullptr;
+
+		if (isCreated)
+		{
+			completion.identity.context = std::move(completion.context);
+			add(std::move(completion.identity));
+			save(); // a lost mapping would orphan the key
+		}
+
+		if (completion.callback)
+		{
+			completion.callback(isCreated);
+		}
+	}
+}
+
+bool IdentityManager::generate(const Identity &identity)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(_directory, ec);
+
+	const std::string certificatePath = getCertificatePath(identity.id);
+	const std::string keyPath = getKeyPath(identity.id);
+
+	EVP_PKEY *key = generateKey();
+	X509 *certificate = key != nullptr ? createCertificate(key, identity.name) : nullptr;
+	bool isWritten = false;
+
+	if (certificate != nullptr)
+	{
+		if (FILE *keyFile = fopen(keyPath.c_str(), "wb"))
+		{
+			std::filesystem::permissions(keyPath, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write, ec);
+			isWritten = PEM_write_PrivateKey(keyFile, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+			isWritten = fclose(keyFile) == 0 && isWritten;
+		}
+
+		if (FILE *certificateFile = isWritten ? fopen(certificatePath.c_str(), "wb") : nullptr)
+		{
+			isWritten = PEM_write_X509(certificateFile, certificate) == 1;
+			isWritten = fclose(certificateFile) == 0 && isWritten;
+		}
+		else
+		{
+			isWritten = false;
+		}
+	}
+
+	X509_free(certificate);
+	EVP_PKEY_free(key);
+
+	if (!isWritten)
+	{
+		fprintf(stderr, "Failed to create a client certificate in \"%s\"\n", _directory.c_str());
+		std::remove(keyPath.c_str());
+		std::remove(certificatePath.c_str());
+	}
+
+	return isWritten;
+}
+
+void IdentityManager::add(Identity identity)
+{
+	const size_t index = _identities.size();
+
+	for (const std::string &prefix : identity.urlPrefixes)
+	{
+		_prefixes.emplace_back(prefix, index);
+	}
+
+	_identities.push_back(std::move(identity));
+
+	std::stable_sort(_prefixes.begin(), _prefixes.end(), [](const auto &a, const auto &b) { return a.first.size() > b.first.size(); });
+}
+
+std::string IdentityManager::getCertificatePath(uint32_t id)
+{
+	return (std::filesystem::path(_directory) / ("identity" + std::to_string(id) + ".crt")).string();
+}
+
+std::string IdentityManager::getKeyPath(uint32_t id)
+{
+	return (std::filesystem::path(_directory) / ("identity" + std::to_string(id) + ".key")).string();
+}
@@ -0,0 +1,251 @@
+#include "KnownHosts.hpp"
+
+#include <chrono>
+#include <cstring>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace gem;
+
+namespace
+{
+	static constexpr uint32_t fileMagic = 0x484b4d47; // "GMKH"
+	static constexpr uint32_t fileVersion = 1;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+	};
+
+	static uint64_t hashHost(std::string_view hostName, size_t port)
+	{
+		uint64_t hash = 14695981039346656037ull; // FNV-1a
+
+		for (unsigned char c : std::string(hostName) + ':' + std::to_string(port))
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	static int64_t getCurrentTime()
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+}
+
+// Stored as it is in the file
+struct KnownHosts::Record
+{
+	uint64_t hash;
+	Fingerprint fingerprint;
+	int64_t expiryTime;
+};
+
+KnownHosts::~KnownHosts()
+{
+	close();
+}
+
+void KnownHosts::open(const std::string &path)
+{
+	close();
+	_path = path;
+
+	const char *data = nullptr;
+	size_t size = 0;
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (LARGE_INTEGER fileSize; file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+	{
+		size = static_cast<size_t>(fileSize.QuadPart);
+
+		if (HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr)
+		{
+			data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+	}
+
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	struct stat fileStat;
+
+	if (file >= 0 && fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+	{
+		size = static_cast<size_t>(fileStat.st_size);
+		void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+		data = mapping != MAP_FAILED ? static_cast<const char *>(mapping) : nullptr;
+	}
+
+	if (file >= 0)
+	{
+		::close(file); // the mapping stays valid
+	}
+#endif
+
+	bool isValid = false;
+
+	if (data != nullptr && size >= sizeof(FileHeader))
+	{
+		FileHeader header;
+		memcpy(&header, data, sizeof(header));
+
+		if (header.magic == fileMagic && header.version == fileVersion)
+		{
+			const size_t recordCount = (size - sizeof(FileHeader)) / sizeof(Record);
+			_hosts.reserve(recordCount);
+
+			for (size_t i = 0; i < recordCount; i++)
+			{
+				Record record;
+				memcpy(&record, data + sizeof(FileHeader) + i * sizeof(Record), sizeof(record));
+				_hosts[record.hash] = {record.fingerprint, record.expiryTime};
+			}
+
+			// a partial record is left over by an interrupted append
+			isValid = (size - sizeof(FileHeader)) % sizeof(Record) == 0;
+		}
+	}
+
+	if (data != nullptr)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(data);
+#else
+		munmap(const_cast<char *>(data), size);
+#endif
+	}
+
+	if (isValid)
+	{
+		_file = fopen(path.c_str(), "ab");
+		return;
+	}
+
+	// starts over with the records that could be read
+	if (_file = fopen(path.c_str(), "wb"); _file != nullptr)
+	{
+		const FileHeader header {fileMagic, fileVersion};
+		fwrite(&header, sizeof(header), 1, _file);
+
+		for (const auto &[hash, host] : _hosts)
+		{
+			append(hash, host);
+		}
+
+		fflush(_file);
+	}
+}
+
+void KnownHosts::close()
+{
+	if (_file != nullptr)
+	{
+		fclose(_file);
+		_file = nullptr;
+	}
+
+	_hosts.clear();
+}
+
+KnownHosts::Result KnownHosts::verify(SSL *ssl, std::string_view hostName, size_t port)
+{
+	X509 *certificate = SSL_get_peer_certificate(ssl);
+
+	if (certificate == nullptr)
+	{
+		return Result::Mismatch;
+	}
+
+	Host host {};
+	bool isHashed = false;
+
+	// the key survives certificate renewals by servers that keep it
+	if (X509_PUBKEY *publicKey = X509_get_X509_PUBKEY(certificate))
+	{
+		unsigned char *der = nullptr;
+
+		if (int derSize = i2d_X509_PUBKEY(publicKey, &der); derSize > 0)
+		{
+			unsigned int hashSize = 0;
+			isHashed = EVP_Digest(der, static_cast<size_t>(derSize), host.fingerprint.data(), &hashSize, EVP_sha256(), nullptr) == 1 && hashSize == host.fingerprint.size();
+			OPENSSL_free(der);
+		}
+	}
+
+	int days = 0;
+	int seconds = 0;
+	host.expiryTime = getCurrentTime();
+
+	if (ASN1_TIME_diff(&days, &seconds, nullptr, X509_get0_notAfter(certificate)) == 1)
+	{
+		host.expiryTime += static_cast<int64_t>(days) * 24 * 60 * 60 + seconds;
+	}
+
+	X509_free(certificate);
+
+	if (!isHashed)
+	{
+		return Result::Mismatch;
+	}
+
+	const uint64_t hash = hashHost(hostName, port);
+	auto it = _hosts.find(hash);
+
+	if (it != _hosts.end() && it->second.fingerprint == host.fingerprint)
+	{
+		// a renewed certificate with the same key extends the trust
+		if (host.expiryTime > it->second.expiryTime + 24 * 60 * 60 && _file != nullptr)
+		{
+			it->second.expiryTime = host.expiryTime;
+			append(hash, host);
+			fflush(_file);
+		}
+
+		return Result::Trusted;
+	}
+
+	if (it != _hosts.end() && it->second.expiryTime > getCurrentTime())
+	{
+		return Result::Mismatch;
+	}
+
+	const Result result = it == _hosts.end() ? Result::FirstUse : Result::Replaced;
+	_hosts[hash] = host;
+
+	if (_file != nullptr)
+	{
+		append(hash, host);
+		fflush(_file);
+	}
+
+	return result;
+}
+
+void KnownHosts::append(uint64_t hash, const Host &host)
+{
+	const Record record {hash, host.fingerprint, host.expiryTime};
+	fwrite(&record, sizeof(record), 1, _file);
+}
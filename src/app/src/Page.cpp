@@ -1,9 +1,19 @@
 #include "Page.hpp"
 
+#include "DiskCache.hpp"
+#include "DownloadManager.hpp"
+#include "IdentityManager.hpp"
+#include "Prefetcher.hpp"
+#include "RedirectMemo.hpp"
+#include "ResponseCache.hpp"
+#include "Statistics.hpp"
 #include "Utilities.hpp"
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
+#include <charconv>
+#include <cctype>
+#include <unordered_set>
 
 #include <stb_image.h>
 #include <SDL_opengl.h>
@@ -19,6 +29,22 @@ namespace
 				(stringStartsWith(&mime[6], "png") || stringStartsWith(&mime[6], "jpeg") || stringStartsWith(&mime[6], "gif")));
 	}
 
+	static PageType getMetaPageType(std::string_view meta)
+	{
+		// text is shown while it arrives, images once complete, everything else goes to disk
+		if (stringStartsWith(meta, "text"))
+		{
+			return stringStartsWith(&meta[5], "gemini") ? PageType::Gemtext : PageType::Text;
+		}
+
+		if (stringStartsWith(meta, "image") && (stringStartsWith(&meta[6], "png") || stringStartsWith(&meta[6], "jpeg") || stringStartsWith(&meta[6], "gif")))
+		{
+			return PageType::None; // becomes PageType::Image when decoded
+		}
+
+		return PageType::Unsupported;
+	}
+
 	static inline void clearPageData(PageType type, PageData *data)
 	{
 		if (data != nullptr)
@@ -36,9 +62,62 @@ namespace
 		delete data;
 	}
 
-	static void loadImageFromMemory(unsigned char *data, int size, int &width, int &height, unsigned int &textureId)
+	static void prefetchLinkedHosts(const std::vector<GemtextLine> &lines, std::string_view pageHostName)
+	{
+		std::unordered_set<std::string_view> hostNames;
+
+		for (const GemtextLine &line : lines)
+		{
+			if (line.type == GemtextLineType::Link && line.linkHasSchema && stringStartsWith(line.link, "gemini://"))
+			{
+				if (std::string_view hostName = extractHostName(line.link); !hostName.empty() && hostName != pageHostName)
+				{
+					hostNames.insert(hostName);
+				}
+			}
+		}
+
+		if (!hostNames.empty())
+		{
+			GeminiClient::prefetchHosts(std::vector<std::string>(hostNames.begin(), hostNames.end()));
+		}
+	}
+
+	struct BodyReader
+	{
+		const Body &body;
+		size_t offset;
+	};
+
+	static const stbi_io_callbacks bodyReaderCallbacks
+	{
+		[](void *user, char *data, int size) -> int
+		{
+			BodyReader &reader = *static_cast<BodyReader *>(user);
+			const size_t count = std::min(static_cast<size_t>(size), reader.body.size() - reader.offset);
+
+			reader.body.copy(reader.offset, count, data);
+			reader.offset += count;
+
+			return static_cast<int>(count);
+		},
+		[](void *user, int count)
+		{
+			BodyReader &reader = *static_cast<BodyReader *>(user);
+			reader.offset = count < 0 ? reader.offset - std::min(reader.offset, static_cast<size_t>(-count)) : std::min(reader.offset + count, reader.body.size());
+		},
+		[](void *user) -> int
+		{
+			const BodyReader &reader = *static_cast<BodyReader *>(user);
+			return reader.offset >= reader.body.size();
+		}
+	};
+
+	// the decoder reads the segments through callbacks, the body is never flattened
+	static void loadImage(const Body &body, int &width, int &height, unsigned int &textureId)
 	{
-		unsigned char *imageData = stbi_load_from_memory(data, size, &width, &height, nullptr, 4);
+		BodyReader reader {body, 0};
+		unsigned char *imageData = stbi_load_from_callbacks(&bodyReaderCallbacks, &reader, &width, &height, nullptr, 4);
 
 		glGenTextures(1, &textureId);
 		glBindTexture(GL_TEXTURE_2D, textureId);
@@ -56,9 +135,32 @@ namespace
 	}
 }
 
+struct Page::Transfer
+{
+	std::string url;
+	std::string key; // normalized URL
+	std::vector<std::weak_ptr<Page>> pages; // waiting for this transfer
+	std::weak_ptr<GeminiClient> client;
+	std::shared_ptr<ClientIdentity> identity; // of the URL when the request started
+	RequestScheduler::RequestId requestId {0};
+	RequestPriority priority {RequestPriority::Speculative}; // the highest of the waiting pages
+	uint32_t slowDownRetryCount {0};
+	std::vector<std::string> redirectedFrom; // normalized URLs, to detect loops
+	bool hasHeader {false};
+	StatusCode statusCode {StatusCode::NONE};
+	std::string meta;
+	std::shared_ptr<Body> body;
+};
+
+std::unordered_map<std::string, std::shared_ptr<Page::Transfer>> Page::_transfers;
+
 const Page Page::newTabPage = Page(PageType::NewTab, "New Tab");
+const Page Page::statisticsPage = Page(PageType::Statistics, "Statistics");
+const Page Page::downloadsPage = Page(PageType::Downloads, "Downloads");
 
-Page::Page(std::string url) : _url {url}
+Page::Page(std::string url) :
+	_url {url},
+	_requestedUrl {url}
 {
 }
 
@@ -70,11 +172,11 @@ Page::Page(PageType type, std::string_view label) :
 
 Page::Page(const Page &page) :
 	_url {page._url},
+	_requestedUrl {page._requestedUrl},
 	_label {page._label},
 	_pageType {page._pageType},
 	_pageData {nullptr},
 	_isLoaded {page._isLoaded},
-	_isDownloaded {page._isDownloaded},
 	_code {page._code},
 	_error {page._error},
 	_meta {page._meta},
@@ -84,6 +186,7 @@ Page::Page(const Page &page) :
 
 Page::~Page()
 {
+	abort(); // the last page leaving a transfer releases its connection right away
 	clearPageData(_pageType, _pageData);
 }
 
@@ -97,9 +200,11 @@ std::string_view Page::getLabel()
 	return _label;
 }
 
-std::string_view Page::getData()
+const Body &Page::getData()
 {
-	return std::string_view(_binaryData->data(), _binaryData->size());
+	static const Body emptyBody;
+
+	return _binaryData ? *_binaryData : emptyBody;
 }
 
 std::string_view Page::getError()
@@ -107,6 +212,11 @@ std::string_view Page::getError()
 	return _error;
 }
 
+StatusCode Page::getStatusCode()
+{
+	return _code;
+}
+
 PageType Page::getPageType()
 {
 	return _pageType;
@@ -117,48 +227,160 @@ bool Page::isLoaded()
 	return _isLoaded;
 }
 
-bool Page::isDownloaded()
+void Page::load(bool isReload)
+{
+	_isLoaded = false;
+	_error.clear(); // a retry starts over
+	_loadStartTime = std::chrono::steady_clock::now();
+
+	abort();
+
+	if (isReload && !_requestedUrl.empty())
+	{
+		// a mistaken or temporary 31 must not stick, the server decides again
+		_url = _requestedUrl;
+		RedirectMemo::remove(normalizeUrl(_url));
+	}
+
+	// known permanent redirects skip the round trip
+	for (uint32_t i = 0; i < maxRedirects && !isReload; i++)
+	{
+		if (const std::string *target = RedirectMemo::find(normalizeUrl(_url)))
+		{
+			_url = *target;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	const std::string key = normalizeUrl(_url);
+
+	if (_priority != RequestPriority::Speculative)
+	{
+		Prefetcher::markUsed(key);
+	}
+
+	if (isReload)
+	{
+		ResponseCache::remove(key);
+	}
+	else if (const CachedResponse *response = ResponseCache::find(key))
+	{
+		statistics.responseCacheHits.fetch_add(1, std::memory_order_relaxed);
+
+		init(response->statusCode, response->meta, response->body);
+		onData(true);
+
+		return;
+	}
+	else
+	{
+		statistics.responseCacheMisses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (auto it = _transfers.find(key); it != _transfers.end())
+	{
+		// join the transfer in flight instead of opening another connection
+		statistics.coalescedRequests.fetch_add(1, std::memory_order_relaxed);
+
+		_transfer = it->second;
+		_transfer->pages.push_back(weak_from_this());
+		updatePriority(_transfer);
+
+		if (_transfer->hasHeader)
+		{
+			init(_transfer->statusCode, _transfer->meta, _transfer->body);
+
+			if (!_transfer->body->empty())
+			{
+				onData(false);
+			}
+		}
+
+		return;
+	}
+
+	_transfer = std::make_shared<Transfer>();
+	_transfer->url = _url;
+	_transfer->key = key;
+	_transfer->body = std::make_shared<Body>();
+	_transfer->pages.push_back(weak_from_this());
+	_transfer->priority = _priority;
+	_transfers.emplace(key, _transfer);
+
+	startTransfer(_transfer); // the disk cache is only read when the network fails
+}
+
+void Page::cancel()
 {
-	return _isDownloaded;
+	if (_transfer)
+	{
+		abort();
+		setError(GeminiClient::ClientCode::CANCELLED); // detached pages receive no more callbacks
+	}
 }
 
-void Page::load()
+void Page::setPriority(RequestPriority priority)
 {
-	_isLoaded = false;
-	_isDownloaded = false;
+	if (_priority != priority)
+	{
+		_priority = priority;
 
-	std::shared_ptr<GeminiClient> client = std::make_shared<GeminiClient>();
-	client->connectAsync(std::bind(&connectAsyncCallback, client, weak_from_this(), std::placeholders::_1), _url, 1965);
+		if (_transfer)
+		{
+			updatePriority(_transfer);
+		}
+	}
 }
 
-void Page::download(const char *path)
+void Page::abort()
 {
-	_isDownloaded = true;
-
-	if (path == nullptr)
+	if (!_transfer)
 	{
 		return;
 	}
 
-	std::ofstream ofs(path, std::ios::binary);
+	std::shared_ptr<Transfer> transfer = std::move(_transfer);
+	_transfer.reset();
+
+	std::vector<std::weak_ptr<Page>> &pages = transfer->pages;
+	pages.erase(std::remove_if(pages.begin(), pages.end(),
+		[this](const std::weak_ptr<Page> &pageWeakPtr)
+		{
+			std::shared_ptr<Page> page = pageWeakPtr.lock();
+			return !page || page.get() == this;
+		}
+	), pages.end());
 
-	if (ofs)
+	if (!pages.empty())
 	{
-		ofs.write(_binaryData->data(), _binaryData->size());
+		updatePriority(transfer);
+		return;
 	}
-	else
+
+	// the last waiting page is gone
+	RequestScheduler::cancel(transfer->requestId);
+	transfer->requestId = 0;
+
+	if (std::shared_ptr<GeminiClient> client = transfer->client.lock())
 	{
-		fprintf(stderr, "Failed to save file to the directory \"%s\"\n", path);
+		client->cancel();
 	}
+
+	finishTransfer(transfer);
 }
 
-void Page::init(StatusCode code, std::string meta, std::shared_ptr<std::vector<char>> data)
+void Page::init(StatusCode code, std::string meta, std::shared_ptr<Body> data)
 {
 	_code = code;
 	_meta = meta;
-	_isLoaded = true;
 
 	clearPageData(_pageType, _pageData);
+	_pageData = nullptr;
+	_pageType = PageType::None;
+	_parsedSize = 0;
 
 	if (_code == StatusCode::SUCCESS)
 	{
@@ -177,56 +399,132 @@ void Page::init(StatusCode code, std::string meta, std::shared_ptr<std::vector<c
 	{
 		_error = std::to_string(static_cast<int>(code)) + " " + statusCodeToString(code);
 		_label = _error;
+		setLoaded();
+		return;
+	}
+
+	_pageType = getMetaPageType(meta);
+
+	if (_pageType == PageType::Gemtext)
+	{
+		_pageData = new GemtextPageData();
+	}
+	else if (_pageType == PageType::Text)
+	{
+		_pageData = new TextPageData();
+	}
+}
+
+void Page::onData(bool isLastChunk)
+{
+	if (_priority == RequestPriority::Speculative)
+	{
+		if (isLastChunk)
+		{
+			setLoaded(); // only the cache needs the response, it is neither parsed nor decoded
+		}
+
 		return;
 	}
 
-	if (!_binaryData)
+	if (_pageType == PageType::Gemtext)
+	{
+		// reparsing after every 25% of growth keeps the total work linear
+		if (isLastChunk || _binaryData->size() >= _parsedSize + _parsedSize / 4)
+		{
+			parseGemtext();
+		}
+	}
+	else if (_pageType == PageType::Text)
+	{
+		if (isLastChunk || _binaryData->size() >= _parsedSize + _parsedSize / 4)
+		{
+			splitText();
+		}
+	}
+
+	if (!isLastChunk)
 	{
 		return;
 	}
 
-	_pageType = PageType::Unsupported;
+	setLoaded();
 
-	if (stringStartsWith(meta, "text"))
+	if (_pageType == PageType::Gemtext)
 	{
-		_pageType = PageType::Text;
+		prefetchLinkedHosts(getPageData<GemtextPageData>()->lines, extractHostName(_url));
+		Prefetcher::prefetchLinks(_url, getPageData<GemtextPageData>()->lines);
+	}
+	else if (_pageType == PageType::None)
+	{
+		_pageType = PageType::Image;
+
+		ImagePageData *imagePageData = new ImagePageData();
+		_pageData = imagePageData;
+
+		loadImage(*_binaryData, imagePageData->imageWidth, imagePageData->imageHeight, imagePageData->textureId);
+	}
+}
+
+void Page::parseGemtext()
+{
+	GemtextPageData *gemtextPageData = getPageData<GemtextPageData>();
+	GemtextParser::parse(gemtextPageData->lines, gemtextPageData->joinedText, *_binaryData);
 
-		if (stringStartsWith(&meta[5], "gemini"))
+	_parsedSize = _binaryData->size();
+
+	for (const GemtextLine &line : gemtextPageData->lines)
+	{
+		if (line.type != GemtextLineType::Block && !line.text.empty())
 		{
-			_pageType = PageType::Gemtext;
+			_label = line.text;
+			break;
+		}
+	}
+}
+
+void Page::splitText()
+{
+	TextPageData *textPageData = getPageData<TextPageData>();
+	textPageData->blocks.clear();
+	textPageData->joinedText.clear();
+
+	const Body &body = *_binaryData;
+	size_t blockStart = 0;
 
-			GemtextPageData *gemtextPageData = new GemtextPageData();
-			_pageData = gemtextPageData;
-			GemtextParser::parse(gemtextPageData->lines, *_binaryData);
+	// segments are viewed in place up to their last line break, only a line across a boundary is joined
+	for (size_t i = 0, segmentStart = 0; i < body.getSegmentCount(); segmentStart += body.getSegment(i).size(), i++)
+	{
+		const std::string_view segment = body.getSegment(i);
+
+		if (blockStart < segmentStart)
+		{
+			const size_t lineEnd = segment.find('\n');
 
-			for (const GemtextLine &line : gemtextPageData->lines)
+			if (lineEnd == std::string_view::npos)
 			{
-				if (line.type != GemtextLineType::Block && !line.text.empty())
-				{
-					_label = line.text;
-					break;
-				}
+				continue; // the line goes on
 			}
+
+			textPageData->blocks.push_back(body.view(blockStart, segmentStart + lineEnd - blockStart, textPageData->joinedText));
+			blockStart = segmentStart + lineEnd + 1;
 		}
-	}
-	else if (stringStartsWith(meta, "image"))
-	{
-		if (stringStartsWith(&meta[6], "png") || stringStartsWith(&meta[6], "jpeg") || stringStartsWith(&meta[6], "gif"))
+
+		const size_t lastLineEnd = segment.rfind('\n');
+
+		if (lastLineEnd != std::string_view::npos && segmentStart + lastLineEnd >= blockStart)
 		{
-			_pageType = PageType::Image;
-
-			ImagePageData *imagePageData = new ImagePageData();
-			_pageData = imagePageData;
-
-			loadImageFromMemory(
-				reinterpret_cast<unsigned char *>(_binaryData->data()),
-				static_cast<int>(_binaryData->size()),
-				imagePageData->imageWidth,
-				imagePageData->imageHeight,
-				imagePageData->textureId
-			);
+			textPageData->blocks.push_back(segment.substr(blockStart - segmentStart, segmentStart + lastLineEnd - blockStart));
+			blockStart = segmentStart + lastLineEnd + 1;
 		}
 	}
+
+	if (blockStart < body.size())
+	{
+		textPageData->blocks.push_back(body.view(blockStart, body.size() - blockStart, textPageData->joinedText));
+	}
+
+	_parsedSize = body.size();
 }
 
 void Page::setError(GeminiClient::ClientCode code)
@@ -252,77 +550,383 @@ void Page::setError(GeminiClient::ClientCode code)
 		case GeminiClient::ClientCode::RESPONSE_HEADER_MALFORMED:
 			_error = "The site returned a malformed Gemini response header.";
 			break;
+		case GeminiClient::ClientCode::TIMEOUT:
+			_error = "The site took too long to respond.";
+			break;
+		case GeminiClient::ClientCode::CANCELLED:
+			_error = "Loading was stopped.";
+			break;
+		case GeminiClient::ClientCode::CERTIFICATE_MISMATCH:
+			_error = "The site presented a different certificate than on your first visit, before the old one expired.\nSomeone may be intercepting the connection, so the page was not loaded.";
+			break;
 		default:
 			assert(false);
 			break;
 	}
 
+	setLoaded();
+}
+
+void Page::setLoaded()
+{
 	_isLoaded = true;
+	_transfer.reset();
+
+	if (_priority != RequestPriority::Speculative)
+	{
+		auto loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _loadStartTime);
+		statistics.addPageLoad(static_cast<uint64_t>(loadTime.count()));
+	}
+}
+
+void Page::startTransfer(const std::shared_ptr<Transfer> &transfer)
+{
+	transfer->requestId = RequestScheduler::submit(std::string(extractHostName(transfer->url)), transfer->priority,
+		[transferWeakPtr = std::weak_ptr<Transfer>(transfer)]()
+		{
+			if (std::shared_ptr<Transfer> transfer = transferWeakPtr.lock())
+			{
+				std::shared_ptr<GeminiClient> client = std::make_shared<GeminiClient>();
+				transfer->identity = IdentityManager::find(transfer->url);
+				client->connectAsync(std::bind(&connectAsyncCallback, client, transfer, std::placeholders::_1), transfer->url, 1965, transfer->identity);
+				transfer->client = client;
+			}
+		}
+	);
+}
+
+void Page::finishTransfer(const std::shared_ptr<Transfer> &transfer)
+{
+	if (auto it = _transfers.find(transfer->key); it != _transfers.end() && it->second == transfer)
+	{
+		_transfers.erase(it);
+	}
+
+	RequestScheduler::finish(transfer->requestId);
+	transfer->requestId = 0;
 }
-void Page::connectAsyncCallback(std::shared_ptr<GeminiClient> client, std::weak_ptr<Page> pageWeakPtr, GeminiClient::ClientCode clientCode)
+
+void Page::failTransfer(const std::shared_ptr<Transfer> &transfer, GeminiClient::ClientCode clientCode)
 {
-	if (pageWeakPtr.expired())
+	RequestScheduler::finish(transfer->requestId);
+	transfer->requestId = 0;
+
+	if (clientCode != GeminiClient::ClientCode::HOST_NAME_RESOLUTION_ERROR &&
+		clientCode != GeminiClient::ClientCode::CONNECTION_ERROR &&
+		clientCode != GeminiClient::ClientCode::TIMEOUT)
 	{
+		finishTransfer(transfer);
+
+		for (const std::shared_ptr<Page> &page : getPages(transfer))
+		{
+			page->setError(clientCode);
+		}
+
 		return;
 	}
 
-	std::shared_ptr<Page> page = pageWeakPtr.lock();
+	// the network is down, an outdated copy is better than nothing
+	DiskCache::loadAsync(transfer->key, DiskCache::anyAge,
+		[transfer, clientCode](std::optional<CachedResponse> response)
+		{
+			if (response)
+			{
+				statistics.diskCacheHits.fetch_add(1, std::memory_order_relaxed);
+				statistics.offlineLoads.fetch_add(1, std::memory_order_relaxed);
+				completeFromCache(transfer, *response);
+				return;
+			}
 
-	if (clientCode == GeminiClient::ClientCode::SUCCESS)
+			statistics.diskCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+			finishTransfer(transfer);
+
+			for (const std::shared_ptr<Page> &page : getPages(transfer))
+			{
+				page->setError(clientCode);
+			}
+		}
+	);
+}
+
+void Page::completeFromCache(const std::shared_ptr<Transfer> &transfer, const CachedResponse &response)
+{
+	finishTransfer(transfer);
+
+	transfer->hasHeader = true;
+	transfer->statusCode = response.statusCode;
+	transfer->meta = response.meta;
+	transfer->body = response.body;
+
+	ResponseCache::store(transfer->key, response);
+
+	for (const std::shared_ptr<Page> &page : getPages(transfer))
 	{
-		client->receiveResponseHeaderAsync(std::bind(&receiveResponseHeaderAsyncCallback, client, pageWeakPtr, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		page->init(response.statusCode, response.meta, response.body);
+		page->onData(true);
+	}
+}
+
+void Page::updatePriority(const std::shared_ptr<Transfer> &transfer)
+{
+	RequestPriority priority = RequestPriority::Speculative;
+
+	for (const std::weak_ptr<Page> &pageWeakPtr : transfer->pages)
+	{
+		if (std::shared_ptr<Page> page = pageWeakPtr.lock())
+		{
+			priority = std::min(priority, page->_priority);
+		}
+	}
+
+	if (transfer->priority != priority)
+	{
+		transfer->priority = priority;
+		RequestScheduler::setPriority(transfer->requestId, priority);
+	}
+}
+
+std::vector<std::shared_ptr<Page>> Page::getPages(const std::shared_ptr<Transfer> &transfer)
+{
+	std::vector<std::shared_ptr<Page>> pages;
+
+	for (const std::weak_ptr<Page> &pageWeakPtr : transfer->pages)
+	{
+		if (std::shared_ptr<Page> page = pageWeakPtr.lock())
+		{
+			pages.push_back(std::move(page));
+		}
+	}
+
+	return pages;
+}
+
+bool Page::followRedirect(const std::shared_ptr<Transfer> &transfer, StatusCode statusCode, std::string_view meta)
+{
+	if (meta.empty() || transfer->redirectedFrom.size() >= maxRedirects)
+	{
+		return false; // shown as an error
+	}
+
+	std::string target = resolveUrl(meta, meta.find("://") != std::string_view::npos, transfer->url);
+	std::string targetKey = normalizeUrl(target);
+
+	if (!stringStartsWith(target, "gemini://") || targetKey == transfer->key ||
+		std::find(transfer->redirectedFrom.begin(), transfer->redirectedFrom.end(), targetKey) != transfer->redirectedFrom.end())
+	{
+		return false; // other protocols are not followed, loops are shown as an error
+	}
+
+	if (statusCode == StatusCode::REDIRECT_PERMANENT)
+	{
+		RedirectMemo::store(transfer->key, target);
+	}
+
+	RequestScheduler::finish(transfer->requestId);
+	transfer->requestId = 0;
+	transfer->client.reset();
+
+	// loads of the target join this transfer from now on
+	if (auto it = _transfers.find(transfer->key); it != _transfers.end() && it->second == transfer)
+	{
+		_transfers.erase(it);
+	}
+
+	transfer->redirectedFrom.push_back(std::move(transfer->key));
+
+	if (auto it = _transfers.find(targetKey); it != _transfers.end())
+	{
+		// the target is already being loaded, the pages join that transfer instead of fetching it twice
+		const std::shared_ptr<Transfer> existing = it->second;
+		existing->redirectedFrom.insert(existing->redirectedFrom.end(), transfer->redirectedFrom.begin(), transfer->redirectedFrom.end());
+
+		for (const std::shared_ptr<Page> &page : getPages(transfer))
+		{
+			statistics.coalescedRequests.fetch_add(1, std::memory_order_relaxed);
+
+			page->_url = target;
+			page->_transfer = existing;
+			existing->pages.push_back(page);
+
+			if (existing->hasHeader)
+			{
+				page->init(existing->statusCode, existing->meta, existing->body);
+
+				if (!existing->body->empty())
+				{
+					page->onData(false);
+				}
+			}
+		}
+
+		transfer->pages.clear();
+		updatePriority(existing);
+
+		return true;
+	}
+
+	transfer->url = target;
+	transfer->key = std::move(targetKey);
+	_transfers.emplace(transfer->key, transfer);
+
+	for (const std::shared_ptr<Page> &page : getPages(transfer))
+	{
+		page->_url = target; // relative links are resolved against the final location
+	}
+
+	if (const CachedResponse *response = ResponseCache::find(transfer->key))
+	{
+		completeFromCache(transfer, *response);
 	}
 	else
 	{
-		page->setError(clientCode);
+		startTransfer(transfer);
 	}
+
+	return true;
 }
 
-void Page::receiveResponseHeaderAsyncCallback(std::shared_ptr<GeminiClient> client, std::weak_ptr<Page> pageWeakPtr, GeminiClient::ClientCode clientCode, StatusCode statusCode, std::string meta)
+bool Page::retryAfterSlowDown(const std::shared_ptr<Transfer> &transfer, std::string_view meta)
 {
-	if (pageWeakPtr.expired())
+	int delay = 0;
+	const std::from_chars_result result = std::from_chars(meta.data(), meta.data() + meta.size(), delay);
+
+	if (result.ec != std::errc() || delay < 0)
 	{
-		return;
+		delay = defaultSlowDownDelay;
+	}
+
+	if (transfer->slowDownRetryCount >= maxSlowDownRetries || delay > maxSlowDownDelay)
+	{
+		return false; // shown as an error
 	}
 
-	std::shared_ptr<Page> page = pageWeakPtr.lock();
+	const std::string_view hostName = extractHostName(transfer->url);
+	fprintf(stderr, "Host %.*s asked to slow down, retrying in %d s\n", static_cast<int>(hostName.size()), hostName.data(), delay);
 
+	transfer->slowDownRetryCount++;
+	transfer->client.reset();
+
+	// the pause must be registered before the slot is released, finishing starts the queued requests
+	RequestScheduler::slowDown(hostName, std::chrono::seconds(delay));
+	RequestScheduler::finish(transfer->requestId);
+	startTransfer(transfer);
+
+	return true;
+}
+
+void Page::connectAsyncCallback(std::shared_ptr<GeminiClient> client, std::shared_ptr<Transfer> transfer, GeminiClient::ClientCode clientCode)
+{
 	if (clientCode == GeminiClient::ClientCode::SUCCESS)
 	{
-		// TODO: do not download the whole file directly into memory!
+		client->receiveResponseHeaderAsync(std::bind(&receiveResponseHeaderAsyncCallback, client, transfer, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+		return;
+	}
 
-		//if (isMimeSupported(meta))
-		//{
-		//	client->receiveResponseBodyAsync(std::bind(&receiveResponseBodyAsyncCallback, pageWeakPtr, statusCode, meta, std::placeholders::_1, std::placeholders::_2));
-		//}
-		//else
-		//{
-		//	page->init(statusCode, meta, nullptr);
-		//}
+	failTransfer(transfer, clientCode);
+}
 
-		client->receiveResponseBodyAsync(std::bind(&receiveResponseBodyAsyncCallback, pageWeakPtr, statusCode, meta, std::placeholders::_1, std::placeholders::_2));
+void Page::receiveResponseHeaderAsyncCallback(std::shared_ptr<GeminiClient> client, std::shared_ptr<Transfer> transfer, GeminiClient::ClientCode clientCode, StatusCode statusCode, std::string meta)
+{
+	if (clientCode != GeminiClient::ClientCode::SUCCESS)
+	{
+		failTransfer(transfer, clientCode);
+		return;
+	}
+
+	std::vector<std::shared_ptr<Page>> pages = getPages(transfer);
+
+	if (pages.empty())
+	{
+		finishTransfer(transfer);
+		return;
+	}
+
+	if (statusCode == StatusCode::SLOW_DOWN && retryAfterSlowDown(transfer, meta))
+	{
+		return;
+	}
+
+	if ((statusCode == StatusCode::REDIRECT_TEMPORARY || statusCode == StatusCode::REDIRECT_PERMANENT) && followRedirect(transfer, statusCode, meta))
+	{
+		return;
+	}
+
+	transfer->hasHeader = true;
+	transfer->statusCode = statusCode;
+	transfer->meta = meta;
+
+	for (const std::shared_ptr<Page> &page : pages)
+	{
+		page->init(statusCode, meta, transfer->body);
+	}
+
+	if (statusCode != StatusCode::SUCCESS)
+	{
+		finishTransfer(transfer);
+	}
+	else if (getMetaPageType(meta) == PageType::Unsupported)
+	{
+		finishTransfer(transfer);
+
+		for (const std::shared_ptr<Page> &page : pages)
+		{
+			page->setLoaded();
+		}
+
+		auto it = std::find_if(pages.begin(), pages.end(), [](const std::shared_ptr<Page> &page) { return page->_priority != RequestPriority::Speculative; });
+
+		if (it != pages.end())
+		{
+			DownloadManager::start(client, transfer->url, std::string((*it)->getLabel()));
+		}
+		// otherwise nobody asked for the file and the connection is dropped
 	}
 	else
 	{
-		page->setError(clientCode);
+		// the pending callback owns the client until the body ends, the transfer only observes it
+		client->receiveResponseBodyStreamAsync(
+			[client, transfer](GeminiClient::ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk)
+			{
+				receiveResponseChunkCallback(transfer, clientCode, std::move(chunk), isLastChunk);
+			}
+		);
 	}
 }
 
-void Page::receiveResponseBodyAsyncCallback(std::weak_ptr<Page> pageWeakPtr, StatusCode statusCode, std::string meta, GeminiClient::ClientCode clientCode, std::shared_ptr<std::vector<char>> data)
+void Page::receiveResponseChunkCallback(std::shared_ptr<Transfer> transfer, GeminiClient::ClientCode clientCode, std::shared_ptr<Buffer> chunk, bool isLastChunk)
 {
-	if (pageWeakPtr.expired())
+	if (clientCode != GeminiClient::ClientCode::SUCCESS)
 	{
+		finishTransfer(transfer);
+
+		for (const std::shared_ptr<Page> &page : getPages(transfer))
+		{
+			page->setError(clientCode);
+		}
+
 		return;
 	}
 
-	std::shared_ptr<Page> page = pageWeakPtr.lock();
+	// one body shared by every waiting page, the chunk goes back to the client right away
+	transfer->body->append(chunk->data(), chunk->size());
+	statistics.bodyBytesCopied.fetch_add(chunk->size(), std::memory_order_relaxed);
 
-	if (clientCode == GeminiClient::ClientCode::SUCCESS)
+	if (isLastChunk)
 	{
-		page->init(statusCode, meta, data);
+		finishTransfer(transfer);
+
+		CachedResponse response {transfer->statusCode, transfer->meta, transfer->body};
+		ResponseCache::store(transfer->key, response);
+
+		if (!transfer->identity) // personal pages are not written to disk
+		{
+			DiskCache::store(transfer->key, std::move(response));
+		}
 	}
-	else
+
+	for (const std::shared_ptr<Page> &page : getPages(transfer))
 	{
-		page->setError(clientCode);
+		page->onData(isLastChunk);
 	}
-}
\ No newline at end of file
+}
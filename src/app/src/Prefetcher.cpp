@@ -0,0 +1,193 @@
+#include "Prefetcher.hpp"
+
+#include "Page.hpp"
+#include "ResponseCache.hpp"
+#include "Statistics.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+
+using namespace gem;
+
+std::vector<Prefetcher::Prefetch> Prefetcher::_prefetches;
+std::unordered_map<std::string, Prefetcher::UnusedPage> Prefetcher::_unusedPages;
+size_t Prefetcher::_budget = 0;
+
+void Prefetcher::setBudget(size_t budget)
+{
+	_budget = budget;
+
+	if (_budget == 0)
+	{
+		_prefetches.clear(); // the pages stop loading when destroyed
+		_unusedPages.clear();
+	}
+}
+
+void Prefetcher::prefetchLinks(std::string_view pageUrl, const std::vector<GemtextLine> &lines)
+{
+	if (_budget == 0)
+	{
+		return;
+	}
+
+	const std::string_view hostName = extractHostName(pageUrl);
+	size_t linkCount = 0;
+
+	// links near the top of a page are the likeliest to be followed
+	for (const GemtextLine &line : lines)
+	{
+		if (linkCount == maxLinksPerPage || getHostPageCount(hostName) >= maxPagesPerHost || getUsedSize() >= _budget)
+		{
+			break;
+		}
+
+		if (line.type != GemtextLineType::Link)
+		{
+			continue;
+		}
+
+		const std::string url = resolveUrl(line.link, line.linkHasSchema, pageUrl);
+
+		if (!stringStartsWith(url, "gemini://") || extractHostName(url) != hostName || !isWorthPrefetching(url))
+		{
+			continue;
+		}
+
+		std::string key = normalizeUrl(url);
+
+		if (key == normalizeUrl(pageUrl) || isKnown(key))
+		{
+			continue;
+		}
+
+		statistics.prefetchesStarted.fetch_add(1, std::memory_order_relaxed);
+
+		auto page = std::make_shared<Page>(url);
+		page->setPriority(RequestPriority::Speculative);
+		_prefetches.push_back({std::move(key), std::string(hostName), page, false});
+		page->load();
+
+		linkCount++;
+	}
+}
+
+void Prefetcher::markUsed(const std::string &url)
+{
+	if (auto it = _unusedPages.find(url); it != _unusedPages.end())
+	{
+		statistics.prefetchesUsed.fetch_add(1, std::memory_order_relaxed);
+		_unusedPages.erase(it);
+		return;
+	}
+
+	auto it = std::find_if(_prefetches.begin(), _prefetches.end(), [&url](const Prefetch &prefetch) { return prefetch.url == url; });
+
+	if (it != _prefetches.end() && !it->isUsed)
+	{
+		statistics.prefetchesUsed.fetch_add(1, std::memory_order_relaxed);
+		it->isUsed = true;
+	}
+}
+
+void Prefetcher::update()
+{
+	if (_prefetches.empty() && _unusedPages.empty())
+	{
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+
+	for (auto it = _unusedPages.begin(); it != _unusedPages.end();)
+	{
+		// pages evicted from the cache or long forgotten no longer hold the budget
+		if (now - it->second.time >= unusedExpiration || !ResponseCache::contains(it->first))
+		{
+			it = _unusedPages.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	for (auto it = _prefetches.begin(); it != _prefetches.end();)
+	{
+		if (!it->page->isLoaded())
+		{
+			if (!it->isUsed && getUsedSize() > _budget)
+			{
+				it->page->cancel(); // a large response, not worth it
+			}
+
+			++it;
+			continue;
+		}
+
+		if (!it->isUsed && it->page->getError().empty())
+		{
+			_unusedPages[it->url] = {it->hostName, it->page->getData().capacity(), now};
+		}
+
+		it = _prefetches.erase(it);
+	}
+}
+
+bool Prefetcher::isWorthPrefetching(std::string_view url)
+{
+	if (url.find('?') != std::string_view::npos)
+	{
+		return false; // queries may have side effects
+	}
+
+	const size_t pathPos = url.find('/', 9); // after "gemini://"
+
+	if (pathPos == std::string_view::npos)
+	{
+		return true; // the capsule's index
+	}
+
+	const std::string_view path = url.substr(pathPos);
+	const std::string_view fileName = path.substr(path.find_last_of('/') + 1);
+	const size_t dotPos = fileName.find_last_of('.');
+
+	if (dotPos == std::string_view::npos)
+	{
+		return true; // directories and extensionless pages are usually gemtext
+	}
+
+	const std::string_view extension = fileName.substr(dotPos + 1);
+
+	return extension == "gmi" || extension == "gemini" || extension == "txt";
+}
+
+bool Prefetcher::isKnown(const std::string &url)
+{
+	return ResponseCache::contains(url) ||
+		_unusedPages.find(url) != _unusedPages.end() ||
+		std::any_of(_prefetches.begin(), _prefetches.end(), [&url](const Prefetch &prefetch) { return prefetch.url == url; });
+}
+
+size_t Prefetcher::getHostPageCount(std::string_view hostName)
+{
+	return std::count_if(_prefetches.begin(), _prefetches.end(), [hostName](const Prefetch &prefetch) { return prefetch.hostName == hostName; }) +
+		std::count_if(_unusedPages.begin(), _unusedPages.end(), [hostName](const auto &entry) { return entry.second.hostName == hostName; });
+}
+
+size_t Prefetcher::getUsedSize()
+{
+	size_t size = 0;
+
+	for (const Prefetch &prefetch : _prefetches)
+	{
+		size += prefetch.isUsed ? 0 : prefetch.page->getData().capacity();
+	}
+
+	for (const auto &[url, unusedPage] : _unusedPages)
+	{
+		size += unusedPage.size;
+	}
+
+	return size;
+}
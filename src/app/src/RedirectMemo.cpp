@@ -0,0 +1,101 @@
+#include "RedirectMemo.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/prettywriter.h>
+
+using namespace gem;
+
+std::unordered_map<std::string, std::string> RedirectMemo::_targets;
+std::deque<std::string> RedirectMemo::_urls;
+
+void RedirectMemo::save(std::string_view path)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+
+	writer.Key("redirects");
+	writer.StartArray();
+
+	for (const std::string &url : _urls)
+	{
+		writer.StartObject();
+		writer.Key("url");
+		writer.String(url);
+		writer.Key("target");
+		writer.String(_targets[url]);
+		writer.EndObject();
+	}
+
+	writer.EndArray();
+
+	writer.EndObject();
+
+	std::ofstream ofs(path.data(), std::ios::binary);
+	ofs.write(buffer.GetString(), buffer.GetSize());
+}
+
+void RedirectMemo::load(std::string_view path)
+{
+	if (path.empty() || !std::filesystem::exists(path))
+	{
+		return;
+	}
+
+	std::ifstream ifs(path.data(), std::ios::binary | std::ios::ate);
+	std::size_t size = ifs.tellg();
+	std::string buffer(size, '\0');
+	ifs.seekg(0, std::ios::beg);
+	ifs.read(buffer.data(), size);
+
+	rapidjson::Document doc;
+	doc.Parse(buffer.data(), size);
+
+	if (doc.HasParseError() || !doc.HasMember("redirects"))
+	{
+		return;
+	}
+
+	for (const auto &redirectObject : doc["redirects"].GetArray())
+	{
+		store(redirectObject["url"].GetString(), redirectObject["target"].GetString());
+	}
+}
+
+const std::string *RedirectMemo::find(const std::string &url)
+{
+	auto it = _targets.find(url);
+	return it != _targets.end() ? &it->second : nullptr;
+}
+
+void RedirectMemo::store(const std::string &url, std::string target)
+{
+	if (auto it = _targets.find(url); it != _targets.end())
+	{
+		it->second = std::move(target);
+		return;
+	}
+
+	if (_urls.size() == maxEntries)
+	{
+		_targets.erase(_urls.front());
+		_urls.pop_front();
+	}
+
+	_targets.emplace(url, std::move(target));
+	_urls.push_back(url);
+}
+
+void RedirectMemo::remove(const std::string &url)
+{
+	if (_targets.erase(url) > 0)
+	{
+		_urls.erase(std::find(_urls.begin(), _urls.end(), url));
+	}
+}
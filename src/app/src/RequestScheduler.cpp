@@ -0,0 +1,138 @@
+#include "RequestScheduler.hpp"
+
+#include <algorithm>
+
+using namespace gem;
+
+std::vector<RequestScheduler::Request> RequestScheduler::_queue;
+std::unordered_map<RequestScheduler::RequestId, RequestScheduler::ActiveRequest> RequestScheduler::_activeRequests;
+std::unordered_map<std::string, RequestScheduler::Host> RequestScheduler::_hosts;
+RequestScheduler::RequestId RequestScheduler::_lastRequestId = 0;
+
+RequestScheduler::RequestId RequestScheduler::submit(std::string hostName, RequestPriority priority, StartHandler start)
+{
+	const RequestId requestId = ++_lastRequestId;
+	_queue.push_back({requestId, std::move(hostName), priority, std::move(start)});
+
+	startReadyRequests();
+
+	return requestId;
+}
+
+void RequestScheduler::setPriority(RequestId requestId, RequestPriority priority)
+{
+	auto it = std::find_if(_queue.begin(), _queue.end(), [requestId](const Request &request) { return request.id == requestId; });
+
+	if (it != _queue.end())
+	{
+		it->priority = priority;
+	}
+	else if (auto activeIt = _activeRequests.find(requestId); activeIt != _activeRequests.end())
+	{
+		activeIt->second.priority = priority;
+	}
+}
+
+void RequestScheduler::finish(RequestId requestId)
+{
+	if (auto it = _activeRequests.find(requestId); it != _activeRequests.end())
+	{
+		if (auto hostIt = _hosts.find(it->second.hostName); hostIt != _hosts.end())
+		{
+			hostIt->second.activeCount--;
+
+			if (hostIt->second.activeCount == 0 && hostIt->second.pausedUntil <= std::chrono::steady_clock::now())
+			{
+				_hosts.erase(hostIt);
+			}
+		}
+
+		_activeRequests.erase(it);
+		startReadyRequests();
+	}
+}
+
+bool RequestScheduler::cancel(RequestId requestId)
+{
+	auto it = std::find_if(_queue.begin(), _queue.end(), [requestId](const Request &request) { return request.id == requestId; });
+
+	if (it != _queue.end())
+	{
+		_queue.erase(it);
+		return true;
+	}
+
+	finish(requestId);
+
+	return false;
+}
+
+void RequestScheduler::slowDown(std::string_view hostName, std::chrono::seconds delay)
+{
+	Host &host = _hosts[std::string(hostName)];
+	host.pausedUntil = std::max(host.pausedUntil, std::chrono::steady_clock::now() + delay);
+}
+
+void RequestScheduler::update()
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	for (auto it = _hosts.begin(); it != _hosts.end();)
+	{
+		if (it->second.activeCount == 0 && it->second.pausedUntil <= now)
+		{
+			it = _hosts.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if (!_queue.empty())
+	{
+		startReadyRequests();
+	}
+}
+
+bool RequestScheduler::isAvailable(const std::string &hostName, std::chrono::steady_clock::time_point now)
+{
+	auto it = _hosts.find(hostName);
+	return it == _hosts.end() || (it->second.activeCount < maxConnectionsPerHost && it->second.pausedUntil <= now);
+}
+
+void RequestScheduler::startReadyRequests()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const auto isSpeculative = [](RequestPriority priority) { return priority == RequestPriority::Speculative; };
+
+	while (_activeRequests.size() < maxConnections)
+	{
+		// the oldest request of the highest priority whose host can take another connection
+		auto next = _queue.end();
+		bool isBusy = std::any_of(_activeRequests.begin(), _activeRequests.end(), [&](const auto &entry) { return !isSpeculative(entry.second.priority); });
+
+		for (auto it = _queue.begin(); it != _queue.end(); ++it)
+		{
+			isBusy = isBusy || !isSpeculative(it->priority);
+
+			if ((next == _queue.end() || it->priority < next->priority) && isAvailable(it->hostName, now))
+			{
+				next = it;
+			}
+		}
+
+		if (next == _queue.end() || (isSpeculative(next->priority) && isBusy))
+		{
+			break;
+		}
+
+		Request request = std::move(*next);
+		_queue.erase(next);
+
+		_hosts[request.hostName].activeCount++;
+		_activeRequests.emplace(request.id, ActiveRequest {std::move(request.hostName), request.priority});
+
+		request.start();
+	}
+}
@@ -0,0 +1,169 @@
+#include "ResolverCache.hpp"
+#include "Statistics.hpp"
+
+#include <cstdio>
+#include <memory>
+
+#include <asio/error.hpp>
+#include <asio/post.hpp>
+
+using namespace gem;
+
+namespace
+{
+	static inline bool isCacheableError(const asio::error_code &ec)
+	{
+		// NXDOMAIN, no records and refused/failed queries; temporary failures are retried
+		return ec == asio::error::host_not_found || ec == asio::error::no_data || ec == asio::error::no_recovery;
+	}
+
+	static inline std::string makeKey(std::string_view hostName, size_t port)
+	{
+		return std::string(hostName) + ':' + std::to_string(port);
+	}
+}
+
+ResolverCache::ResolverCache(asio::io_context &ioContext) : _ioContext {ioContext}
+{
+}
+
+ResolverCache::~ResolverCache() = default;
+
+void ResolverCache::useDnsResolver(const std::vector<std::string> &nameServers)
+{
+	auto dnsResolver = std::make_unique<DnsResolver>(_ioContext);
+
+	if (dnsResolver->configure(nameServers))
+	{
+		_dnsResolver = std::move(dnsResolver);
+	}
+	else
+	{
+		fputs("No name servers are configured, falling back to the system resolver\n", stderr);
+	}
+}
+
+void ResolverCache::resolveAsync(std::string_view hostName, size_t port, const ResolveCallback &callback)
+{
+	const std::string key = makeKey(hostName, port);
+
+	if (auto it = _entries.find(key); it != _entries.end())
+	{
+		Entry &entry = it->second;
+
+		if (entry.isPending)
+		{
+			statistics.dnsCacheHits.fetch_add(1, std::memory_order_relaxed);
+			entry.waiters.push_back(callback);
+			return;
+		}
+
+		if (std::chrono::steady_clock::now() < entry.expirationTime)
+		{
+			statistics.dnsCacheHits.fetch_add(1, std::memory_order_relaxed);
+			asio::post(_ioContext, [callback, ec = entry.error, endpoints = entry.endpoints]() { callback(ec, endpoints); });
+			return;
+		}
+	}
+
+	statistics.dnsCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+	Entry &entry = _entries[key];
+	entry.waiters.push_back(callback);
+
+	if (!entry.isPending)
+	{
+		lookup(key, std::string(hostName), port);
+	}
+}
+
+void ResolverCache::prefetch(std::string_view hostName, size_t port)
+{
+	const std::string key = makeKey(hostName, port);
+
+	if (auto it = _entries.find(key); it != _entries.end() && (it->second.isPending || std::chrono::steady_clock::now() < it->second.expirationTime))
+	{
+		return;
+	}
+
+	statistics.dnsPrefetches.fetch_add(1, std::memory_order_relaxed);
+
+	lookup(key, std::string(hostName), port);
+}
+
+void ResolverCache::lookup(const std::string &key, std::string hostName, size_t port)
+{
+	_entries[key].isPending = true;
+
+	removeExpiredEntries();
+
+	if (_dnsResolver)
+	{
+		_dnsResolver->resolveAsync(hostName, port,
+			[this, key](const asio::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints, std::chrono::seconds ttl)
+			{
+				store(key, ec, endpoints, ttl);
+			}
+		);
+
+		return;
+	}
+
+	auto resolver = std::make_shared<asio::ip::tcp::resolver>(_ioContext);
+
+	// getaddrinfo does not report record TTLs
+	resolver->async_resolve(hostName, std::to_string(port),
+		[this, key, resolver](const asio::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints)
+		{
+			store(key, ec, endpoints, positiveTtl);
+		}
+	);
+}
+
+void ResolverCache::store(const std::string &key, const asio::error_code &ec, const asio::ip::tcp::resolver::results_type &endpoints, std::chrono::seconds ttl)
+{
+	Entry &entry = _entries[key];
+	std::vector<ResolveCallback> waiters = std::move(entry.waiters);
+
+	entry.waiters.clear();
+	entry.isPending = false;
+	entry.error = ec;
+	entry.endpoints = endpoints;
+	entry.expirationTime = std::chrono::steady_clock::now();
+
+	if (!ec && !endpoints.empty())
+	{
+		entry.expirationTime += ttl;
+	}
+	else if (isCacheableError(ec))
+	{
+		entry.expirationTime += negativeTtl;
+	}
+
+	for (const ResolveCallback &waiter : waiters)
+	{
+		waiter(ec, endpoints);
+	}
+}
+
+void ResolverCache::removeExpiredEntries()
+{
+	if (_entries.size() < _maxEntries)
+	{
+		return;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+
+	for (auto it = _entries.begin(); it != _entries.end();)
+	{
+		if (!it->second.isPending && it->second.expirationTime <= now)
+		{
+			it = _entries.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
\ No newline at end of file
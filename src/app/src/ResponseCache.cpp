@@ -0,0 +1,82 @@
+#include "ResponseCache.hpp"
+
+using namespace gem;
+
+std::list<ResponseCache::Entry> ResponseCache::_entries;
+std::unordered_map<std::string, std::list<ResponseCache::Entry>::iterator> ResponseCache::_index;
+size_t ResponseCache::_size = 0;
+size_t ResponseCache::_capacity = ResponseCache::defaultCapacity;
+
+void ResponseCache::setCapacity(size_t capacity)
+{
+	_capacity = capacity;
+	evict(_capacity);
+}
+
+const CachedResponse *ResponseCache::find(const std::string &url)
+{
+	auto it = _index.find(url);
+
+	if (it == _index.end())
+	{
+		return nullptr;
+	}
+
+	_entries.splice(_entries.begin(), _entries, it->second);
+
+	return &it->second->response;
+}
+
+bool ResponseCache::contains(const std::string &url)
+{
+	return _index.find(url) != _index.end();
+}
+
+void ResponseCache::store(const std::string &url, CachedResponse response)
+{
+	remove(url);
+
+	const size_t size = url.size() + response.meta.size() + (response.body ? response.body->capacity() : 0);
+
+	if (size > _capacity)
+	{
+		return; // would evict everything else
+	}
+
+	evict(_capacity - size);
+
+	_entries.push_front({url, std::move(response), size});
+	_index.emplace(url, _entries.begin());
+	_size += size;
+}
+
+void ResponseCache::remove(const std::string &url)
+{
+	if (auto it = _index.find(url); it != _index.end())
+	{
+		_size -= it->second->size;
+		_entries.erase(it->second);
+		_index.erase(it);
+	}
+}
+
+size_t ResponseCache::getSize()
+{
+	return _size;
+}
+
+size_t ResponseCache::getCapacity()
+{
+	return _capacity;
+}
+
+void ResponseCache::evict(size_t capacity)
+{
+	while (_size > capacity)
+	{
+		const Entry &entry = _entries.back();
+		_size -= entry.size;
+		_index.erase(entry.url);
+		_entries.pop_back();
+	}
+}
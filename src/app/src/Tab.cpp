@@ -29,7 +29,7 @@ void Tab::nextPage()
 {
 	_currentPageIndex++;
 	std::shared_ptr<Page> page = getCurrentPage();
-	_addressBarText = std::string(page->getUrl());
+	showUrl(page->getUrl());
 
 	if (!page->isLoaded())
 	{
@@ -41,7 +41,7 @@ void Tab::prevPage()
 {
 	_currentPageIndex--;
 	std::shared_ptr<Page> page = getCurrentPage();
-	_addressBarText = std::string(page->getUrl());
+	showUrl(page->getUrl());
 
 	if (!page->isLoaded())
 	{
@@ -67,70 +67,26 @@ void Tab::loadCurrentPage()
 	page->load();
 }
 
-void Tab::loadNewPage(std::string_view url, bool hasSchema, std::string_view baseUrl)
+void Tab::reloadCurrentPage()
 {
-	std::string newUrl;
+	std::shared_ptr<Page> page = getCurrentPage();
 
-	if (hasSchema)
+	if (page->getUrl().empty())
 	{
-		newUrl = url;
+		return;
 	}
-	else
-	{
-		if (baseUrl.empty())
-		{
-			baseUrl = getCurrentPage()->getUrl();
-		}
 
-		if (url[0] == '/') // relative to host name
-		{
-			newUrl = "gemini://" + std::string(extractHostName(baseUrl)) + std::string(url);
-		}
-		else // relative to current page
-		{
-			auto getDirName = [](std::string_view path)
-			{
-				return path.substr(0, path.find_last_of('/', path.size() - 2) + 1);
-			};
-
-			if (*baseUrl.rbegin() != '/') // current page is not a directory
-			{
-				baseUrl = getDirName(baseUrl);
-			}
-
-			std::string_view relativeUrl = url;
-
-			if (relativeUrl == ".")
-			{
-				relativeUrl = "";
-			}
-			else if (relativeUrl == "..")
-			{
-				baseUrl = getDirName(baseUrl);
-				relativeUrl = "";
-			}
-			else
-			{
-				if (stringStartsWith(relativeUrl, "./"))
-				{
-					relativeUrl = relativeUrl.substr(2);
-				}
-
-				while (stringStartsWith(relativeUrl, "../"))
-				{
-					baseUrl = getDirName(baseUrl);
-					relativeUrl = relativeUrl.substr(3);
-				}
-			}
-
-			newUrl = std::string(baseUrl) + std::string(relativeUrl);
-		}
-	}
+	page->load(true);
+}
+
+void Tab::loadNewPage(std::string_view url, bool hasSchema, std::string_view baseUrl)
+{
+	const std::string newUrl = resolveUrl(url, hasSchema, hasSchema || !baseUrl.empty() ? baseUrl : getCurrentPage()->getUrl());
 
 	_pages.resize(_currentPageIndex + 1);
 	_pages.push_back(std::make_shared<Page>(newUrl));
 	_currentPageIndex++;
-	_addressBarText = std::string(getCurrentPage()->getUrl());
+	showUrl(getCurrentPage()->getUrl());
 
 	loadCurrentPage();
 }
@@ -140,7 +96,7 @@ void Tab::loadNewPage(std::shared_ptr<Page> page)
 	_pages.resize(_currentPageIndex + 1);
 	_pages.push_back(page);
 	_currentPageIndex++;
-	_addressBarText = std::string(getCurrentPage()->getUrl());
+	showUrl(getCurrentPage()->getUrl());
 
 	if (!page->isLoaded())
 	{
@@ -148,7 +104,66 @@ void Tab::loadNewPage(std::shared_ptr<Page> page)
 	}
 }
 
+void Tab::hoverLink(std::string_view url, bool hasSchema)
+{
+	const std::string linkUrl = resolveUrl(url, hasSchema, getCurrentPage()->getUrl());
+
+	if (!stringStartsWith(linkUrl, "gemini://"))
+	{
+		return;
+	}
+
+	_isLinkHovered = true;
+
+	if (std::string_view hostName = extractHostName(linkUrl); hostName != _hoveredHostName)
+	{
+		if (_isPreconnecting)
+		{
+			GeminiClient::cancelPreconnect(_hoveredHostName);
+		}
+
+		_hoveredHostName = hostName;
+		_hoverStartTime = std::chrono::steady_clock::now();
+		_isPreconnecting = false;
+	}
+
+	// links merely swept over by the pointer are not worth a connection
+	if (!_isPreconnecting && std::chrono::steady_clock::now() - _hoverStartTime >= preconnectHoverDelay)
+	{
+		GeminiClient::preconnect(_hoveredHostName);
+		_isPreconnecting = true;
+	}
+}
+
+void Tab::updateLinkHover()
+{
+	if (!_isLinkHovered && !_hoveredHostName.empty())
+	{
+		if (_isPreconnecting)
+		{
+			GeminiClient::cancelPreconnect(_hoveredHostName); // the pointer left the link
+		}
+
+		_hoveredHostName.clear();
+		_isPreconnecting = false;
+	}
+
+	_isLinkHovered = false;
+}
+
 std::string &Tab::getAddressBarText()
 {
+	// a redirect changes the URL of the loading page, unless the user is editing the address
+	if (std::string_view url = getCurrentPage()->getUrl(); url != _shownUrl && _addressBarText == _shownUrl)
+	{
+		showUrl(url);
+	}
+
 	return _addressBarText;
+}
+
+void Tab::showUrl(std::string_view url)
+{
+	_addressBarText = url;
+	_shownUrl = _addressBarText;
 }
\ No newline at end of file
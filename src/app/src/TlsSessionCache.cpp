@@ -0,0 +1,121 @@
+#include "TlsSessionCache.hpp"
+
+#include <asio/ip/address.hpp>
+
+using namespace gem;
+
+namespace
+{
+	// asio keeps its own callbacks in the app data slots, so the cache uses separate indices
+	static int getContextIndex()
+	{
+		static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+		return index;
+	}
+
+	static void freeKey(void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *)
+	{
+		delete static_cast<std::string *>(ptr);
+	}
+
+	static int getKeyIndex()
+	{
+		static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, freeKey);
+		return index;
+	}
+
+	static std::string makeKey(std::string_view hostName, size_t port)
+	{
+		return std::string(hostName) + ':' + std::to_string(port);
+	}
+}
+
+TlsSessionCache::~TlsSessionCache()
+{
+	for (auto &[key, session] : _sessions)
+	{
+		SSL_SESSION_free(session);
+	}
+}
+
+void TlsSessionCache::attach(SSL_CTX *context)
+{
+	SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_set_ex_data(context, getContextIndex(), this);
+	SSL_CTX_sess_set_new_cb(context, newSessionCallback);
+}
+
+void TlsSessionCache::prepare(SSL *ssl, std::string_view hostName, size_t port)
+{
+	const std::string host(hostName);
+	asio::error_code ec;
+	asio::ip::make_address(host, ec);
+
+	if (ec) // SNI is not allowed for IP literals
+	{
+		SSL_set_tlsext_host_name(ssl, host.c_str());
+	}
+
+	std::string *key = new std::string(makeKey(hostName, port));
+	SSL_set_ex_data(ssl, getKeyIndex(), key); // freed together with the SSL object
+
+	if (auto it = _sessions.find(*key); it != _sessions.end())
+	{
+		SSL_SESSION *session = it->second;
+
+		if (SSL_SESSION_is_resumable(session))
+		{
+			SSL_set_session(ssl, session);
+		}
+
+		// TLS 1.3 tickets are single use, the server sends fresh ones after the handshake
+		if (!SSL_SESSION_is_resumable(session) || SSL_SESSION_get_protocol_version(session) == TLS1_3_VERSION)
+		{
+			SSL_SESSION_free(session);
+			_sessions.erase(it);
+		}
+	}
+}
+
+SSL_SESSION *TlsSessionCache::find(std::string_view hostName, size_t port) const
+{
+	if (auto it = _sessions.find(makeKey(hostName, port)); it != _sessions.end() && SSL_SESSION_is_resumable(it->second))
+	{
+		return it->second;
+	}
+
+	return nullptr;
+}
+
+int TlsSessionCache::newSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+	auto cache = static_cast<TlsSessionCache *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), getContextIndex()));
+	auto key = static_cast<const std::string *>(SSL_get_ex_data(ssl, getKeyIndex()));
+
+	if (cache == nullptr || key == nullptr)
+	{
+		return 0;
+	}
+
+	cache->store(*key, session);
+
+	return 1; // the cache keeps the reference
+}
+
+void TlsSessionCache::store(const std::string &key, SSL_SESSION *session)
+{
+	if (auto it = _sessions.find(key); it != _sessions.end())
+	{
+		SSL_SESSION_free(it->second);
+		it->second = session;
+		return;
+	}
+
+	if (_sessions.size() >= _maxSessions)
+	{
+		SSL_SESSION_free(_sessions.begin()->second);
+		_sessions.erase(_sessions.begin());
+	}
+
+	_sessions.emplace(key, session);
+}
\ No newline at end of file
@@ -1,5 +1,37 @@
 #include "App.hpp"
 
+#if defined(GEM_COUNT_ALLOCATIONS)
+#include "Statistics.hpp"
+
+#include <cstdlib>
+#include <new>
+
+void *operator new(std::size_t size)
+{
+	if (gem::countsAllocations)
+	{
+		gem::statistics.networkAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (void *ptr = std::malloc(size != 0 ? size : 1))
+	{
+		return ptr;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+#endif
+
 #include <SDL_main.h>
 
 #ifdef __cplusplus